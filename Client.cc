@@ -6,13 +6,16 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <omnetpp.h>
 #include <algorithm>
 #include <list>
 #include <random>
 #include <sstream>
+#include <map>
 #include "LogMessage_m.h"
 #include "LogMessageResponse_m.h"
+#include "TimerModule.h"
 
 using namespace omnetpp;
 using std::vector;
@@ -20,8 +23,19 @@ using std::__cxx11::to_string;
 using std::string;
 using std::to_string;
 using std::count;
+using std::map;
+using std::min;
+
+// request sent and not acknowledged yet
+struct outstanding_request {
+    LogMessage *message;    // copy kept for the retransmissions
+    cMessage *timeout;      // timer of the window slot taken by the request: the request is sent again when it fires
+    bool backingOff;        // the server answered RETRY (or does not know the leader): send it again to the same server
+    int retries;            // times the request was sent again after a RETRY or a timeout
+    int redirects;          // times the request was redirected to the leader
+};
 
-class Client : public cSimpleModule
+class Client : public TimerModule
 {
 private:
     bool crashed;     // this is useful to shut down a client
@@ -30,33 +44,49 @@ private:
     cMessage *failureMsg;             // this message is useful to shut down a client
     cMessage *recoveryMsg;            // this message is useful to revive a client
     cMessage *sendLogEntry;           // send a request to the leader
-    cMessage *reqTimeoutExpired;       // autoMessage to check whether the last request was acknowledged
-    cMessage *tryAgainMsg;
     cMessage *channelLinkProblem;
 
-    int leaderAddress;
+    int leaderAddress;  // last known leader: requests go there until a redirect or a timeout says otherwise
     int randomIndex; // Random index for the leader within the client's configuration vector
     int networkAddress;
     vector<int> configuration;
 
     // Each command must have a unique ID. Solution: the ID (within the network) of the given Client module first, followed by a counter.
     int commandCounter;
-    bool freeToSend = true; // True if the last request was acknowledged by the leader
-
-    LogMessage *lastLogMessage = nullptr;
+    int maxOutstanding;     // requests in flight at the same time
+    map<int, outstanding_request> outstanding;  // requests not acknowledged yet, by serial number
+    vector<cMessage *> freeRequestTimers;       // timeouts of the window slots not taken by a request
+
+    // RETRIES: jittered exponential backoff
+    double retryBackoffBase;
+    double retryBackoffMax;
+    cOutVector retriesPerRequest;
+    cOutVector redirectsPerRequest;
+    long totalRetries = 0;
+    long totalRedirects = 0;
+    long acknowledgedRequests = 0;
 
     cModule *Switch;
     double clientCrashProbability;
     double maxCrashDelay;
     double clientMaxCrashDuration;
 
+    string workload;        // "registers" or "kv"
+    int kvKeySpace;         // number of distinct keys used by the kv workload
+    bool kvIntegerKeys;     // kv keys are integers instead of names
+    bool readsFromAnyServer; // read-only requests go to a random server instead of the leader (follower reads)
 
 protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
-    virtual void scheduleNewMessage(char operation, char varName, int value); // this method is useful to generate a message that a client have to send to the log in the leader server (WORK IN PROGRESS)
+    virtual void scheduleNewMessage(char operation, char varName, int value, string key = "", string kvValue = ""); // this method is useful to generate a message that a client have to send to the log in the leader server (WORK IN PROGRESS)
     virtual void sendRandomMessage();
+    virtual void sendRandomKeyValueCommand();
+    virtual void resendRequest(int serialNumber);
+    virtual void scheduleNextRequest();
+    virtual double backoffDelay(int retries);
+    virtual int nextServer(int serverAddress);
     virtual void initializeConfiguration();
     virtual void scheduleNextCrash();
     virtual char convertToChar(int operation);
@@ -79,22 +109,43 @@ void Client::initialize()
     randomIndex = intuniform(0, configuration.size() - 1); // The first request is sent to a random server
     leaderAddress = configuration[randomIndex];
     commandCounter = 0;
+    maxOutstanding = par("maxOutstanding");
+    // the servers remember the last 64 serial numbers of each client
+    if (maxOutstanding < 1 || maxOutstanding > 64)
+        throw cRuntimeError("maxOutstanding must be between 1 and 64");
+    // one timeout per window slot, reused by the requests that take the slot
+    for (int i = 0; i < maxOutstanding; i++)
+    {
+        freeRequestTimers.push_back(createTimer(("requestTimeout" + to_string(i)).c_str()));
+    }
+    retryBackoffBase = par("retryBackoffBase");
+    retryBackoffMax = par("retryBackoffMax");
+    retriesPerRequest.setName("retriesPerRequest");
+    redirectsPerRequest.setName("redirectsPerRequest");
 
     clientCrashProbability = getParentModule()->par("clientsCrashProbability");
     maxCrashDelay = getParentModule()->par("clientsMaxCrashDelay");
     clientMaxCrashDuration = getParentModule()->par("clientsMaxCrashDuration");
+    workload = par("workload").stdstringValue();
+    kvKeySpace = par("kvKeySpace");
+    kvIntegerKeys = par("kvIntegerKeys");
+    readsFromAnyServer = par("readsFromAnyServer");
+
+    // INITIALIZE AUTOMESSAGES
+    failureMsg = createTimer("failureMsg");
+    recoveryMsg = createTimer("recoveryMsg");
+    sendLogEntry = createTimer("Sending requests");
+    channelLinkProblem = createTimer("channel connection problem");
 
     scheduleNextCrash();
     // here expires the first timeout; so the first server with timeout expired sends the first leader election message
-    sendLogEntry = new cMessage("I start to send entries.");
     double randomTimeout = uniform(0, 1);
-    scheduleAt(simTime() + randomTimeout, sendLogEntry);
+    startTimer(sendLogEntry, randomTimeout);
 
     activationCrashLink = getParentModule()->par("activationlinkCrashClient");
     if (activationCrashLink == 1){
-        channelLinkProblem = new cMessage("channel connection problem begins");
         double random = uniform(0, 6);
-        scheduleAt(simTime() + random, channelLinkProblem);
+        startTimer(channelLinkProblem, random);
     }
 }
 
@@ -114,10 +165,9 @@ void Client::handleMessage(cMessage *msg)
         dispStr.parse("i=device/pc,red");
         bubble("Client crash");
         // Schedule Recovery Message
-        recoveryMsg = new cMessage("recoveryMsg");
         double randomFailureTime = uniform(0.1, clientMaxCrashDuration);
         EV << "\nClient will be down for about " + to_string(randomFailureTime) + " seconds\n";
-        scheduleAt(simTime() + randomFailureTime, recoveryMsg);
+        startTimer(recoveryMsg, randomFailureTime);
     }
 
     if (msg == recoveryMsg)
@@ -130,9 +180,14 @@ void Client::handleMessage(cMessage *msg)
         // here we schedule the next client crash
         scheduleNextCrash();
         // restart sending messages
-        sendLogEntry = new cMessage("Sending requests");
         double randomTimeout = uniform(0, 1);
-        scheduleAt(simTime() + randomTimeout, sendLogEntry);
+        startTimer(sendLogEntry, randomTimeout);
+        // the timeouts that fired during the crash were lost
+        for (auto it = outstanding.begin(); it != outstanding.end(); it++)
+        {
+            if (!it->second.timeout->isScheduled())
+                startTimer(it->second.timeout, 1);
+        }
     }
 
     // ################################################ NORMAL BEHAVIOUR ################################################
@@ -147,75 +202,84 @@ void Client::handleMessage(cMessage *msg)
     {
         if (msg == sendLogEntry)
         {
-            // here the timeout has expired; client starts sending logMessage in loop
-            if (freeToSend)
+            // here the timeout has expired; client starts sending logMessage in loop, as long as the window is not full
+            if (outstanding.size() < maxOutstanding)
             {
                 sendRandomMessage();
             }
-            else
+            if (outstanding.size() < maxOutstanding)
             {
-                tryAgainMsg = new cMessage("Try again.");
-                scheduleAt(simTime() + 2, tryAgainMsg);
+                scheduleNextRequest();
             }
         }
 
-        else if (msg == reqTimeoutExpired && !freeToSend)
+        // TIMEOUT OF A REQUEST
+        for (auto it = outstanding.begin(); it != outstanding.end(); it++)
         {
-            bubble("Resending after timeout.");
-            randomIndex = intuniform(0, configuration.size() - 1);
-            leaderAddress = configuration[randomIndex];
-            lastLogMessage->setLeaderAddress(leaderAddress);
-            LogMessage *newMex = lastLogMessage->dup();
-            if(gate("gateClient$o", 0)->isConnected())
-                send(newMex, "gateClient$o", 0);
-
-            reqTimeoutExpired = new cMessage("Timeout expired.");
-            scheduleAt(simTime() + 1, reqTimeoutExpired);
-        }
-
-        else if (msg == tryAgainMsg)
-        {
-            LogMessage *newMessage = lastLogMessage->dup();
-            if(gate("gateClient$o", 0)->isConnected())
-                send(newMessage, "gateClient$o", 0);
-            reqTimeoutExpired = new cMessage("Timeout expired.");
-            scheduleAt(simTime() + 1, reqTimeoutExpired);
+            if (msg == it->second.timeout)
+            {
+                resendRequest(it->first);
+                break;
+            }
         }
 
         if (response != nullptr)
         {
+            // responses may arrive in any order, and more than once: look for the request they refer to
+            auto it = outstanding.find(response->getLogSerialNumber());
+            if (it == outstanding.end())
+            {
+                EV << "Client: response to a request already acknowledged\n";
+            }
             // Request acknowledged
-            if (response->getSucceded())
+            else if (response->getSucceded())
             {
-                sendLogEntry = new cMessage("Send new entry.");
-                freeToSend = true;
-                cancelEvent(reqTimeoutExpired);
-
-                double randomTimeout = uniform(0, 1);
-                scheduleAt(simTime() + randomTimeout, sendLogEntry);
+                LogMessage *request = it->second.message;
+                if (request->getOperation() == 'G')
+                {
+                    if (response->getFound())
+                        EV << "Client: " << request->getKey() << " == " << response->getValue() << "\n";
+                    else
+                        EV << "Client: " << request->getKey() << " not found\n";
+                }
+                retriesPerRequest.record(it->second.retries);
+                redirectsPerRequest.record(it->second.redirects);
+                totalRetries += it->second.retries;
+                totalRedirects += it->second.redirects;
+                acknowledgedRequests++;
+                stopTimer(it->second.timeout);
+                freeRequestTimers.push_back(it->second.timeout);
+                delete request;
+                outstanding.erase(it);
+                // a slot is free in the window
+                if (!sendLogEntry->isScheduled())
+                {
+                    scheduleNextRequest();
+                }
             }
             else
             {
-                cancelEvent(reqTimeoutExpired);
+                stopTimer(it->second.timeout);
 
-                if(response->getRedirect())
+                if(response->getRedirect() and response->getLeaderAddress() >= 0)
                 {
-                    // REDIRECT TO ANOTHER SERVER, POSSIBLY THE LEADER
+                    // REDIRECT TO ANOTHER SERVER, POSSIBLY THE LEADER: the hint becomes the known leader
                     bubble("Redirecting command to the leader.");
                     leaderAddress = response->getLeaderAddress();
-                    lastLogMessage->setLeaderAddress(leaderAddress);
-                    LogMessage *newMessage = lastLogMessage->dup();
+                    it->second.redirects++;
+                    it->second.message->setLeaderAddress(leaderAddress);
+                    LogMessage *newMessage = it->second.message->dup();
                     if(gate("gateClient$o", 0)->isConnected())
                         send(newMessage, "gateClient$o", 0);
-                    reqTimeoutExpired = new cMessage("Timeout expired.");
-                    scheduleAt(simTime() + 1, reqTimeoutExpired);
+                    startTimer(it->second.timeout, 1);
                 }
                 else
                 {
-                    // TELL THE CLIENT TO WAIT FOR COMMIT
+                    // TELL THE CLIENT TO WAIT FOR COMMIT, or for the election in progress to end if the
+                    // server does not know the leader: ask the same server again after a while
                     bubble("Waiting for commit.");
-                    tryAgainMsg = new cMessage("Try again.");
-                    scheduleAt(simTime() + 2, tryAgainMsg);
+                    it->second.backingOff = true;
+                    startTimer(it->second.timeout, backoffDelay(it->second.retries));
                 }
             }
         }
@@ -250,15 +314,14 @@ void Client::handleMessage(cMessage *msg)
                     }
                 }
             }
-            channelLinkProblem = new cMessage("another channel connection problem");
             double randomDelay = uniform(0, 3);
-            scheduleAt(simTime() + randomDelay, channelLinkProblem);
+            startTimer(channelLinkProblem, randomDelay);
         }
     }
 }
 
 // It sends a log message, under the assumption that the client already knows a leader
-void Client::scheduleNewMessage(char operation, char varName, int value)
+void Client::scheduleNewMessage(char operation, char varName, int value, string key, string kvValue)
 {
     bubble("Sending a new command");
     commandCounter++;
@@ -268,21 +331,88 @@ void Client::scheduleNewMessage(char operation, char varName, int value)
     logMessage->setOperandName(varName);
     logMessage->setOperandValue(value);
     logMessage->setOperation(operation);
+    logMessage->setKey(key.c_str());
+    logMessage->setValue(kvValue.c_str());
+    logMessage->setReadOnly(operation == 'G');
     logMessage->setSerialNumber(commandCounter);
     logMessage->setLeaderAddress(leaderAddress);
-    lastLogMessage = logMessage->dup();
+    if (operation == 'G' && readsFromAnyServer)
+    {
+        // spread the reads over all the replicas
+        logMessage->setLeaderAddress(configuration[intuniform(0, configuration.size() - 1)]);
+    }
+    outstanding_request request;
+    request.message = logMessage->dup();
+    request.timeout = freeRequestTimers.back();
+    freeRequestTimers.pop_back();
+    request.backingOff = false;
+    request.retries = 0;
+    request.redirects = 0;
+    outstanding[commandCounter] = request;
     WATCH(operation);
     WATCH(value);
     if(gate("gateClient$o", 0)->isConnected())
         send(logMessage, "gateClient$o", 0);
-    freeToSend = false;
 
-    reqTimeoutExpired = new cMessage("Start countdown for my request.");
-    scheduleAt(simTime() + 1, reqTimeoutExpired);
+    startTimer(request.timeout, 1);
+}
+
+// The request was not acknowledged in time: after a RETRY it goes again to the same server,
+// otherwise the server it was sent to may have crashed. If that was the known leader the client moves
+// on to the next server of the configuration, whose redirect will point to the new leader
+void Client::resendRequest(int serialNumber)
+{
+    outstanding_request &request = outstanding[serialNumber];
+    if (!request.backingOff)
+    {
+        bubble("Resending after timeout.");
+        if (request.message->getLeaderAddress() == leaderAddress)
+        {
+            leaderAddress = nextServer(leaderAddress);
+        }
+        // requests sent to other servers (reads spread over the replicas) follow the known leader too
+        request.message->setLeaderAddress(leaderAddress);
+    }
+    request.backingOff = false;
+    request.retries++;
+    LogMessage *newMex = request.message->dup();
+    if(gate("gateClient$o", 0)->isConnected())
+        send(newMex, "gateClient$o", 0);
+    startTimer(request.timeout, 1);
+}
+
+// Exponential in the number of retries, capped at retryBackoffMax, randomized in its upper half
+// so that the clients rejected together do not come back together
+double Client::backoffDelay(int retries)
+{
+    double delay = min(retryBackoffMax, retryBackoffBase * pow(2, retries));
+    return uniform(delay / 2, delay);
+}
+
+int Client::nextServer(int serverAddress)
+{
+    for (int i = 0; i < configuration.size(); i++)
+    {
+        if (configuration[i] == serverAddress)
+            return configuration[(i + 1) % configuration.size()];
+    }
+    randomIndex = intuniform(0, configuration.size() - 1);
+    return configuration[randomIndex];
+}
+
+void Client::scheduleNextRequest()
+{
+    double randomTimeout = uniform(0, 1);
+    startTimer(sendLogEntry, randomTimeout);
 }
 
 void Client::sendRandomMessage()
 {
+    if (workload == "kv")
+    {
+        sendRandomKeyValueCommand();
+        return;
+    }
     int intToChar = intuniform(0, 2);
     char randomOperation = convertToChar(intToChar);
     int intToConvert = intuniform(88, 89); // ASCII code for x and y
@@ -291,6 +421,30 @@ void Client::sendRandomMessage()
     scheduleNewMessage(randomOperation, randomVarName, randomOperand);
 }
 
+// Random command on the key-value store: 40% get, 30% put, 20% increment, 10% delete
+void Client::sendRandomKeyValueCommand()
+{
+    int keyNumber = intuniform(0, kvKeySpace - 1);
+    string key = kvIntegerKeys ? to_string(keyNumber) : "key" + to_string(keyNumber);
+    double sample = uniform(0, 1);
+    if (sample < 0.4)
+    {
+        scheduleNewMessage('G', 'X', 0, key);
+    }
+    else if (sample < 0.7)
+    {
+        scheduleNewMessage('P', 'X', 0, key, "value" + to_string(intuniform(0, 1000)));
+    }
+    else if (sample < 0.9)
+    {
+        scheduleNewMessage('I', 'X', intuniform(-10, 10), key);
+    }
+    else
+    {
+        scheduleNewMessage('D', 'X', 0, key);
+    }
+}
+
 void Client::initializeConfiguration()
 {
     cModule *Switch = gate("gateClient$i", 0)->getPreviousGate()->getOwnerModule();
@@ -317,10 +471,9 @@ void Client::scheduleNextCrash()
     if (crashProbabilitySample < clientCrashProbability)
     {
         double randomDelay = uniform(1, maxCrashDelay);
-        failureMsg = new cMessage("failureMsg");
         EV
         << "Here is client: I will crash in " + to_string(randomDelay) + " seconds...\n";
-        scheduleAt(simTime() + randomDelay, failureMsg);
+        startTimer(failureMsg, randomDelay);
     }
 }
 
@@ -347,4 +500,19 @@ char Client::convertToChar(int operation)
 
 void Client::finish()
 {
+    for (auto it = outstanding.begin(); it != outstanding.end(); it++)
+    {
+        delete it->second.message;
+    }
+    outstanding.clear();
+
+    recordTimerStatistics();
+    recordScalar("acknowledgedRequests", acknowledgedRequests);
+    recordScalar("totalRetries", totalRetries);
+    recordScalar("totalRedirects", totalRedirects);
+    if (acknowledgedRequests > 0)
+    {
+        recordScalar("retriesPerRequestAvg", (double) totalRetries / acknowledgedRequests);
+        recordScalar("redirectsPerRequestAvg", (double) totalRedirects / acknowledgedRequests);
+    }
 }
@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <string.h>
 #include "Server.h"
+#include "Switch.h"
+#include "TimerModule.h"
 #include <omnetpp.h>
 #include <algorithm>
 #include <list>
@@ -22,7 +24,7 @@ using std::string;
 using std::to_string;
 using std::count;
 
-class ConfigurationManager : public cSimpleModule
+class ConfigurationManager : public TimerModule
 {
 private:
     bool crashed;
@@ -58,7 +60,7 @@ private:
     LogMessage *lastLogMessage = nullptr;
     LogMessage *notifyLeaderOfChangeConfig = nullptr;
 
-    cModule *Switch;
+    cModule *switchModule;
     double crashProbability;
     double crashDelay;
 
@@ -91,7 +93,7 @@ void ConfigurationManager::initialize()
     numberOfClients = getParentModule()->par("numClient");
 
     networkAddress = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getIndex();
-    Switch = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
+    switchModule = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
 
     initialConfiguration = initializeConfiguration();
     currentConfiguration = initialConfiguration;
@@ -110,9 +112,15 @@ void ConfigurationManager::initialize()
 
     newServerNumber = intuniform(1,3);
     serverToDelete = intuniform(1,2);
+    // INITIALIZE AUTOMESSAGES
+    failureMsg = createTimer("failureMsg");
+    recoveryMsg = createTimer("recoveryMsg");
+    reqTimeoutExpired = createTimer("Timeout expired.");
+    tryAgainMsg = createTimer("Try again.");
+    deleteServerMsg = createTimer("Delete server");
     //here start the timer for a change configuration
-    timeToChange = new cMessage("timeToChange");
-    scheduleAt(simTime() + 0.5 , timeToChange);
+    timeToChange = createTimer("timeToChange");
+    startTimer(timeToChange, 0.5);
     free = true;
 }
 
@@ -130,10 +138,9 @@ void ConfigurationManager::handleMessage(cMessage *msg)
         dispStr.parse("i=abstract/penguin_l,red");
         bubble("Configuration manager crashes");
         // Schedule Recovery Message
-        recoveryMsg = new cMessage("recoveryMsg");
         double randomFailureTime = uniform(1, 2);
         EV << "Config. Manager will be down for about " + to_string(randomFailureTime) + " seconds\n";
-        scheduleAt(simTime() + randomFailureTime, recoveryMsg);
+        startTimer(recoveryMsg, randomFailureTime);
     }
 
     if (msg == recoveryMsg)
@@ -145,9 +152,8 @@ void ConfigurationManager::handleMessage(cMessage *msg)
         EV << "Config. Manager: I'm back, let's start working again!\n";
         // here we schedule the next client crash
         // restart sending messages
-        timeToChange = new cMessage("Sending requests");
         double randomTimeout = uniform(0, 1);
-        scheduleAt(simTime() + randomTimeout, timeToChange);
+        startTimer(timeToChange, randomTimeout);
     }
 
     if (crashed)
@@ -180,8 +186,7 @@ void ConfigurationManager::handleMessage(cMessage *msg)
             }
             else
             {
-                tryAgainMsg = new cMessage("Try again.");
-                scheduleAt(simTime() + 2, tryAgainMsg);
+                startTimer(tryAgainMsg, 2);
             }
         }
 
@@ -195,8 +200,7 @@ void ConfigurationManager::handleMessage(cMessage *msg)
             if(gate("gateConfigurationManager$o", 0)->isConnected())
                 send(newMessage, "gateConfigurationManager$o", 0);
 
-            reqTimeoutExpired = new cMessage("Timeout expired.");
-            scheduleAt(simTime() + 1, reqTimeoutExpired);
+            startTimer(reqTimeoutExpired, 1);
         }
 
         else if (msg == tryAgainMsg)
@@ -204,8 +208,7 @@ void ConfigurationManager::handleMessage(cMessage *msg)
             newMessage = lastLogMessage->dup();
             if(gate("gateConfigurationManager$o", 0)->isConnected())
                 send(newMessage, "gateConfigurationManager$o", 0);
-            reqTimeoutExpired = new cMessage("Timeout expired.");
-            scheduleAt(simTime() + 1, reqTimeoutExpired);
+            startTimer(reqTimeoutExpired, 1);
         }
 
         else if (msg == deleteServerMsg)
@@ -231,16 +234,14 @@ void ConfigurationManager::handleMessage(cMessage *msg)
                     serverToDelete--;
                 }
                 updateConfiguration();
-                deleteServerMsg = new cMessage("Delete server");
-                scheduleAt(simTime() + 0.5, deleteServerMsg);
-                timeToChange = new cMessage("add/delete new server.");
+                startTimer(deleteServerMsg, 0.5);
                 free = true;
-                cancelEvent(reqTimeoutExpired);
-                scheduleAt(simTime(), timeToChange);
+                stopTimer(reqTimeoutExpired);
+                startTimer(timeToChange, 0);
             }
             else
             {
-                cancelEvent(reqTimeoutExpired);
+                stopTimer(reqTimeoutExpired);
 
                 if(response->getRedirect())
                 {
@@ -251,15 +252,13 @@ void ConfigurationManager::handleMessage(cMessage *msg)
                     newMessage = lastLogMessage->dup();
                     if(gate("gateConfigurationManager$o", 0)->isConnected())
                         send(newMessage, "gateConfigurationManager$o", 0);
-                    reqTimeoutExpired = new cMessage("Timeout expired.");
-                    scheduleAt(simTime() + 1, reqTimeoutExpired);
+                    startTimer(reqTimeoutExpired, 1);
                 }
                 else
                 {
                     // TELL THE CLIENT TO WAIT FOR COMMIT
                     bubble("Waiting for commit.");
-                    tryAgainMsg = new cMessage("Try again.");
-                    scheduleAt(simTime() + 1.5, tryAgainMsg);
+                    startTimer(tryAgainMsg, 1.5);
                 }
             }
         }
@@ -268,11 +267,11 @@ void ConfigurationManager::handleMessage(cMessage *msg)
 
 vector<int> ConfigurationManager::initializeConfiguration()
 {
-    cModule *Switch = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
+    cModule *switchModule = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
     string serverString = "server";
     vector<int> configuration;
 
-    for (cModule::GateIterator iterator(Switch); !iterator.end(); iterator++)
+    for (cModule::GateIterator iterator(switchModule); !iterator.end(); iterator++)
     {
         cGate *gate = *iterator;
         int serverAddress = (gate)->getIndex();
@@ -291,17 +290,17 @@ vector<int> ConfigurationManager::initializeConfiguration()
 
 int ConfigurationManager::addNewServer()
 {
-    cModule *Switch = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
+    cModule *switchModule = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
     cGate *newServerPortIN, *newServerPortOUT;
     cGate *newSwitchPortIN, *newSwitchPortOUT;
     cModule *tempClient;
     numberOfServers++;
 
-    Switch->setGateSize("gateSwitch", Switch->gateSize("gateSwitch$o") + 1);
+    switchModule->setGateSize("gateSwitch", switchModule->gateSize("gateSwitch$o") + 1);
     int index = gate("gateConfigurationManager$o",0)->getNextGate()->size() - 1;
 
-    newSwitchPortIN = Switch->gate("gateSwitch$i", index);
-    newSwitchPortOUT = Switch->gate("gateSwitch$o", index);
+    newSwitchPortIN = switchModule->gate("gateSwitch$i", index);
+    newSwitchPortOUT = switchModule->gate("gateSwitch$o", index);
 
     bubble("Adding new server!");
     cModuleType *moduleType = cModuleType::get("Server");
@@ -323,6 +322,8 @@ int ConfigurationManager::addNewServer()
 
     newSwitchPortOUT->connectTo(newServerPortIN, delayChannelIN);
     newServerPortOUT->connectTo(newSwitchPortIN, delayChannelOUT);
+    // the switch has a new port: its routing table must be rebuilt
+    check_and_cast<Switch *>(switchModule)->updateRoutingTable();
 
     // create internals, and schedule it
     module->buildInside();
@@ -334,20 +335,21 @@ int ConfigurationManager::addNewServer()
 
 void ConfigurationManager::removeServer(int toDelete)
 {
-    cModule *Switch = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
+    cModule *switchModule = gate("gateConfigurationManager$i", 0)->getPreviousGate()->getOwnerModule();
     cModule *serverToDelete;
 
     int serverIndex;
-    int gatesize = Switch->gateSize("gateSwitch$o");
+    int gatesize = switchModule->gateSize("gateSwitch$o");
     for (int i = 0; i < gatesize; i++)
     {
         // There is only one server to delete and disconnect port from the switch
-        serverIndex = Switch->gate("gateSwitch$o", i)->getIndex();
+        serverIndex = switchModule->gate("gateSwitch$o", i)->getIndex();
         if (toDelete == serverIndex)
         {
-            serverToDelete = Switch->gate("gateSwitch$o", i)->getNextGate()->getOwnerModule();
+            serverToDelete = switchModule->gate("gateSwitch$o", i)->getNextGate()->getOwnerModule();
             serverToDelete->gate("gateServer$o", 0)->disconnect();
-            Switch->gate("gateSwitch$o", i)->disconnect();
+            switchModule->gate("gateSwitch$o", i)->disconnect();
+            check_and_cast<Switch *>(switchModule)->removeFromServerGroup(toDelete);
             // Delete the Server
             // serverToDelete->callFinish();
             // shutDownDeletedServer = new cMessage("SHUTDOWN SERVER");
@@ -388,8 +390,7 @@ void ConfigurationManager::scheduleNewMessage(char operation, int serverAddr)
         send(notifyLeaderOfChangeConfig, "gateConfigurationManager$o", 0);
     free = false;
 
-    reqTimeoutExpired = new cMessage("Start countdown for my request.");
-    scheduleAt(simTime() + 1, reqTimeoutExpired);
+    startTimer(reqTimeoutExpired, 1);
 }
 
 void ConfigurationManager::updateConfiguration()
@@ -410,26 +411,15 @@ void ConfigurationManager::updateConfiguration()
 
 ConfigurationManager::~ConfigurationManager()
 {
-    cancelAndDelete(failureMsg);
-    cancelAndDelete(recoveryMsg);
-    cancelAndDelete(reqTimeoutExpired);
-    cancelAndDelete(tryAgainMsg);
     cancelAndDelete(shutDownDeletedServer);
-    cancelAndDelete(timeToChange);
-    cancelAndDelete(deleteServerMsg);
     cancelAndDelete(response);
     cancelAndDelete(newMessage);
 }
 
 void ConfigurationManager::finish()
 {
-    cancelAndDelete(failureMsg);
-    cancelAndDelete(recoveryMsg);
-    cancelAndDelete(reqTimeoutExpired);
-    cancelAndDelete(tryAgainMsg);
+    recordTimerStatistics();
     cancelAndDelete(shutDownDeletedServer);
-    cancelAndDelete(timeToChange);
-    cancelAndDelete(deleteServerMsg);
     cancelAndDelete(response);
     cancelAndDelete(newMessage);
 }
@@ -0,0 +1,121 @@
+/*
+ * HashedKeyValueStore.cc
+ *
+ *  Open-addressing hash table with linear probing for the key-value state machine.
+ */
+#include "HashedKeyValueStore.h"
+
+HashedKeyValueStore::HashedKeyValueStore()
+{
+    slots.resize(INITIAL_CAPACITY);
+    count = 0;
+    tombstones = 0;
+}
+
+// FNV-1a
+uint64_t HashedKeyValueStore::hashKey(const std::string &key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        hash = hash ^ (unsigned char) key[i];
+        hash = hash * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int HashedKeyValueStore::findSlot(const std::string &key, uint64_t hash) const
+{
+    int mask = slots.size() - 1;
+    for (int i = hash & mask; ; i = (i + 1) & mask)
+    {
+        if (slots[i].state == EMPTY)
+            return -1;
+        if (slots[i].state == FULL && slots[i].hash == hash && slots[i].key == key)
+            return i;
+    }
+}
+
+bool HashedKeyValueStore::get(const std::string &key, std::string &value) const
+{
+    int position = findSlot(key, hashKey(key));
+    if (position < 0)
+        return false;
+    value = slots[position].value;
+    return true;
+}
+
+void HashedKeyValueStore::put(const std::string &key, const std::string &value)
+{
+    uint64_t hash = hashKey(key);
+    int position = findSlot(key, hash);
+    if (position >= 0)
+    {
+        slots[position].value = value;
+        return;
+    }
+    if (count + tombstones + 1 > MAX_LOAD * slots.size())
+    {
+        // grow only if the live entries need it, otherwise rebuilding drops the tombstones
+        rehash(count + 1 > MAX_LOAD * slots.size() / 2 ? slots.size() * 2 : slots.size());
+    }
+    int mask = slots.size() - 1;
+    int i = hash & mask;
+    while (slots[i].state == FULL)
+        i = (i + 1) & mask;
+    if (slots[i].state == DELETED)
+        tombstones--;
+    slots[i].state = FULL;
+    slots[i].hash = hash;
+    slots[i].key = key;
+    slots[i].value = value;
+    count++;
+}
+
+bool HashedKeyValueStore::remove(const std::string &key)
+{
+    int position = findSlot(key, hashKey(key));
+    if (position < 0)
+        return false;
+    slots[position].state = DELETED;
+    slots[position].key.clear();
+    slots[position].value.clear();
+    count--;
+    tombstones++;
+    return true;
+}
+
+void HashedKeyValueStore::clear()
+{
+    slots.assign(INITIAL_CAPACITY, slot());
+    count = 0;
+    tombstones = 0;
+}
+
+int HashedKeyValueStore::size() const
+{
+    return count;
+}
+
+int HashedKeyValueStore::capacity() const
+{
+    return slots.size();
+}
+
+void HashedKeyValueStore::rehash(int newCapacity)
+{
+    std::vector<slot> old;
+    old.swap(slots);
+    slots.resize(newCapacity);
+    int mask = newCapacity - 1;
+    for (size_t j = 0; j < old.size(); j++)
+    {
+        if (old[j].state != FULL)
+            continue;
+        int i = old[j].hash & mask;
+        while (slots[i].state == FULL)
+            i = (i + 1) & mask;
+        slots[i] = std::move(old[j]);
+    }
+    tombstones = 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * HashedKeyValueStore.h
+ *
+ *  Open-addressing hash table (linear probing, power-of-two capacity) mapping byte-string
+ *  keys to byte-string values. Deleted slots are marked as tombstones and reused by inserts;
+ *  the table is rebuilt when live entries plus tombstones exceed the maximum load factor.
+ */
+#ifndef HASHEDKEYVALUESTORE_H_
+#define HASHEDKEYVALUESTORE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class HashedKeyValueStore
+{
+public:
+    HashedKeyValueStore();
+
+    bool get(const std::string &key, std::string &value) const;
+    void put(const std::string &key, const std::string &value);
+    bool remove(const std::string &key);
+    void clear();
+
+    int size() const;
+    int capacity() const;
+
+    // visits every live entry (snapshot serialization)
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].state == FULL)
+                visit(slots[i].key, slots[i].value);
+    }
+
+private:
+    enum slot_state { EMPTY, FULL, DELETED };
+    struct slot {
+        slot_state state = EMPTY;
+        uint64_t hash = 0;
+        std::string key;
+        std::string value;
+    };
+
+    static const int INITIAL_CAPACITY = 16;
+    static constexpr double MAX_LOAD = 0.7;
+
+    std::vector<slot> slots;
+    int count;          // live entries
+    int tombstones;     // deleted slots
+
+    static uint64_t hashKey(const std::string &key);
+    int findSlot(const std::string &key, uint64_t hash) const;  // -1 if absent
+    void rehash(int newCapacity);
+};
+
+#endif /* HASHEDKEYVALUESTORE_H_ */
@@ -0,0 +1,143 @@
+/*
+ * LogSegments.cc
+ *
+ *  On-disk copy of the log used to serve AppendEntries, in memory-mapped segment files.
+ */
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "LogSegments.h"
+
+LogSegments::LogSegments()
+{
+    entriesPerSegment = 0;
+    startIndex = 0;
+    lastIndex = -1;
+}
+
+LogSegments::~LogSegments()
+{
+    reset(0);
+}
+
+void LogSegments::open(const std::string &pathPrefix, int entriesPerSegment)
+{
+    this->pathPrefix = pathPrefix;
+    this->entriesPerSegment = entriesPerSegment;
+    reset(0);
+}
+
+bool LogSegments::isOpen() const
+{
+    return entriesPerSegment > 0;
+}
+
+int LogSegments::getStartIndex() const
+{
+    return startIndex;
+}
+
+int LogSegments::getLastIndex() const
+{
+    return lastIndex;
+}
+
+const log_entry* LogSegments::slice(int index, int &count) const
+{
+    if (index < startIndex || index > lastIndex)
+    {
+        count = 0;
+        return nullptr;
+    }
+    // segments are contiguous, the one holding index is found by arithmetic
+    const log_segment &segment = segments[(index - segments.front().baseIndex) / entriesPerSegment];
+    int slot = index - segment.baseIndex;
+    int available = std::min(entriesPerSegment - slot, lastIndex - index + 1);
+    if (count > available)
+        count = available;
+    return segment.slots + slot;
+}
+
+void LogSegments::append(const log_entry &entry)
+{
+    int index = lastIndex + 1;
+    if (segments.empty() || index == segments.back().baseIndex + entriesPerSegment)
+    {
+        addSegment(index);
+    }
+    segments.back().slots[index - segments.back().baseIndex] = entry;
+    lastIndex = index;
+}
+
+void LogSegments::truncateFrom(int index)
+{
+    if (index > lastIndex)
+        return;
+    if (index < startIndex)
+        index = startIndex;
+    while (!segments.empty() && segments.back().baseIndex >= index && segments.back().baseIndex > startIndex)
+    {
+        removeSegment(segments.back());
+        segments.pop_back();
+    }
+    lastIndex = index - 1;
+}
+
+void LogSegments::discardUpTo(int index)
+{
+    if (index < startIndex)
+        return;
+    if (index >= lastIndex)
+    {
+        reset(index + 1);
+        return;
+    }
+    while (segments.front().baseIndex + entriesPerSegment - 1 <= index)
+    {
+        removeSegment(segments.front());
+        segments.pop_front();
+    }
+    startIndex = index + 1;
+}
+
+void LogSegments::reset(int startIndex)
+{
+    while (!segments.empty())
+    {
+        removeSegment(segments.back());
+        segments.pop_back();
+    }
+    this->startIndex = startIndex;
+    lastIndex = startIndex - 1;
+}
+
+int LogSegments::getMappedSegments() const
+{
+    return segments.size();
+}
+
+void LogSegments::addSegment(int baseIndex)
+{
+    log_segment segment;
+    segment.baseIndex = baseIndex;
+    segment.path = pathPrefix + "." + std::to_string(baseIndex);
+    segment.fd = ::open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (segment.fd < 0)
+        throw cRuntimeError("Cannot create log segment %s", segment.path.c_str());
+    size_t length = (size_t) entriesPerSegment * sizeof(log_entry);
+    if (ftruncate(segment.fd, length) != 0)
+        throw cRuntimeError("Cannot size log segment %s", segment.path.c_str());
+    void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+    if (mapped == MAP_FAILED)
+        throw cRuntimeError("Cannot map log segment %s", segment.path.c_str());
+    segment.slots = (log_entry *) mapped;
+    segments.push_back(segment);
+}
+
+void LogSegments::removeSegment(log_segment &segment)
+{
+    munmap(segment.slots, (size_t) entriesPerSegment * sizeof(log_entry));
+    close(segment.fd);
+    unlink(segment.path.c_str());
+}
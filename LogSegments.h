@@ -0,0 +1,57 @@
+/*
+ * LogSegments.h
+ *
+ *  On-disk copy of the log used to serve AppendEntries: the entries are stored in segment
+ *  files of fixed-width slots, memory-mapped, so a run of consecutive entries can be read
+ *  by pointer. Segments entirely below the start index are unmapped and deleted.
+ */
+#ifndef LOGSEGMENTS_H_
+#define LOGSEGMENTS_H_
+
+#include <omnetpp.h>
+#include <string>
+#include <deque>
+#include "structs.h"
+
+// one segment file: slot i holds the entry with Raft index baseIndex + i
+struct log_segment {
+    int baseIndex;
+    std::string path;
+    int fd;
+    log_entry *slots;   // mapped file
+};
+
+class LogSegments
+{
+public:
+    LogSegments();
+    ~LogSegments();
+
+    void open(const std::string &pathPrefix, int entriesPerSegment);
+    bool isOpen() const;
+
+    int getStartIndex() const;
+    int getLastIndex() const;
+    // pointer to the entry at index and to the ones following it in the same segment:
+    // count is reduced to the number of entries that can be read from the returned pointer
+    const log_entry* slice(int index, int &count) const;
+
+    void append(const log_entry &entry);
+    void truncateFrom(int index);
+    void discardUpTo(int index);   // deletes the segments that only hold entries up to index
+    void reset(int startIndex);    // deletes every segment
+
+    int getMappedSegments() const;
+
+private:
+    std::string pathPrefix;
+    int entriesPerSegment;
+    std::deque<log_segment> segments;
+    int startIndex;
+    int lastIndex;
+
+    void addSegment(int baseIndex);
+    void removeSegment(log_segment &segment);
+};
+
+#endif /* LOGSEGMENTS_H_ */
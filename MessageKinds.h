@@ -0,0 +1,40 @@
+/*
+ * MessageKinds.h
+ *
+ *  Message kind of every message exchanged through the switch. Each .msg type sets its own
+ *  kind, so that a message can be recognized without a dynamic_cast.
+ *  Kind 0 is left to the autoMessages.
+ */
+#ifndef MESSAGEKINDS_H_
+#define MESSAGEKINDS_H_
+
+enum message_kind {
+    VOTE_REQUEST_KIND = 1,
+    VOTE_REPLY_KIND,
+    HEARTBEAT_KIND,
+    HEARTBEAT_RESPONSE_KIND,
+    LOG_MESSAGE_KIND,
+    LOG_MESSAGE_RESPONSE_KIND,
+    TIMEOUT_NOW_KIND,
+    INSTALL_SNAPSHOT_KIND,
+    READ_INDEX_REQUEST_KIND,
+    READ_INDEX_RESPONSE_KIND,
+    LEADER_ELECTION_KIND,
+    PING_KIND,
+    PRE_VOTE_REQUEST_KIND,
+    PRE_VOTE_REPLY_KIND,
+    MESSAGE_KINDS   // number of kinds, size of the dispatch tables
+};
+
+// name of a message kind, used for the per-kind statistics
+inline const char *messageKindName(int kind)
+{
+    static const char *names[MESSAGE_KINDS] = {
+        "autoMessage", "voteRequest", "voteReply", "heartBeat", "heartBeatResponse", "logMessage",
+        "logMessageResponse", "timeOutNow", "installSnapshot", "readIndexRequest", "readIndexResponse",
+        "leaderElection", "ping", "preVoteRequest", "preVoteReply"
+    };
+    return (kind >= 0 && kind < MESSAGE_KINDS) ? names[kind] : "unknown";
+}
+
+#endif /* MESSAGEKINDS_H_ */
@@ -0,0 +1,121 @@
+/*
+ * RaftLog.cc
+ *
+ *  Storage of the replicated log: entries live in fixed-size chunks and are addressed
+ *  by their Raft index, so the prefix compacted into a snapshot can be released cheaply.
+ */
+#include "RaftLog.h"
+
+RaftLog::RaftLog()
+{
+    startIndex = 0;
+    firstOffset = 0;
+    count = 0;
+}
+
+int RaftLog::getStartIndex() const
+{
+    return startIndex;
+}
+
+int RaftLog::getLastIndex() const
+{
+    return startIndex + count - 1;
+}
+
+int RaftLog::size() const
+{
+    return count;
+}
+
+bool RaftLog::empty() const
+{
+    return count == 0;
+}
+
+const log_entry& RaftLog::getEntry(int index) const
+{
+    int position = firstOffset + (index - startIndex);
+    return chunks[position / CHUNK_SIZE][position % CHUNK_SIZE];
+}
+
+void RaftLog::append(const log_entry &entry)
+{
+    int position = firstOffset + count;
+    if (position / CHUNK_SIZE == chunks.size())
+    {
+        chunks.push_back(std::unique_ptr<log_entry[]>(new log_entry[CHUNK_SIZE]));
+    }
+    chunks[position / CHUNK_SIZE][position % CHUNK_SIZE] = entry;
+    count++;
+}
+
+void RaftLog::truncateFrom(int index)
+{
+    if (index > getLastIndex())
+    {
+        return;
+    }
+    if (index <= startIndex)
+    {
+        reset(startIndex);
+        return;
+    }
+    count = index - startIndex;
+    // release the chunks that no longer hold any entry
+    int usedChunks = (firstOffset + count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    while (chunks.size() > usedChunks)
+    {
+        chunks.pop_back();
+    }
+}
+
+void RaftLog::discardUpTo(int index)
+{
+    if (index < startIndex)
+    {
+        return;
+    }
+    if (index >= getLastIndex())
+    {
+        reset(index + 1);
+        return;
+    }
+    int toDiscard = index - startIndex + 1;
+    firstOffset = firstOffset + toDiscard;
+    count = count - toDiscard;
+    startIndex = index + 1;
+    // release the chunks that only held discarded entries
+    while (firstOffset >= CHUNK_SIZE)
+    {
+        chunks.pop_front();
+        firstOffset = firstOffset - CHUNK_SIZE;
+    }
+}
+
+void RaftLog::reset(int startIndex)
+{
+    chunks.clear();
+    this->startIndex = startIndex;
+    firstOffset = 0;
+    count = 0;
+}
+
+std::ostream& operator<<(std::ostream& stream, const RaftLog &logEntries)
+{
+    for (int index = logEntries.getStartIndex(); index <= logEntries.getLastIndex(); index++)
+    {
+        stream << "[I: "
+                << logEntries.getEntry(index).entryLogIndex
+                << ",T:"
+                << logEntries.getEntry(index).entryTerm
+                << ",VAR:"
+                << logEntries.getEntry(index).operandName
+                << ",OP:"
+                << logEntries.getEntry(index).operation
+                << ",VAL:"
+                << logEntries.getEntry(index).operandValue
+                << "] ";
+    }
+    return stream;
+}
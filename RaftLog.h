@@ -0,0 +1,43 @@
+/*
+ * RaftLog.h
+ *
+ *  Storage of the replicated log: entries live in fixed-size chunks and are addressed
+ *  by their Raft index, so the prefix compacted into a snapshot can be released cheaply.
+ */
+#ifndef RAFTLOG_H_
+#define RAFTLOG_H_
+
+#include <omnetpp.h>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include "structs.h"
+
+class RaftLog
+{
+public:
+    static const int CHUNK_SIZE = 256; // entries per chunk
+
+    RaftLog();
+
+    int getStartIndex() const;                  // Raft index of the first entry kept in memory
+    int getLastIndex() const;                   // Raft index of the last entry (getStartIndex() - 1 if empty)
+    int size() const;
+    bool empty() const;
+    const log_entry& getEntry(int index) const; // entry at Raft index, getStartIndex() <= index <= getLastIndex()
+
+    void append(const log_entry &entry);        // O(1), references to the other entries stay valid
+    void truncateFrom(int index);               // drops the entries from index on (conflict with the leader's log)
+    void discardUpTo(int index);                // drops the entries up to index (log compaction)
+    void reset(int startIndex);                 // drops every entry, the next one appended gets startIndex
+
+private:
+    std::deque<std::unique_ptr<log_entry[]>> chunks;
+    int startIndex;     // Raft index of the first entry
+    int firstOffset;    // position of the first entry inside chunks.front()
+    int count;          // number of entries
+};
+
+std::ostream& operator<<(std::ostream& stream, const RaftLog &logEntries);
+
+#endif /* RAFTLOG_H_ */
@@ -10,21 +10,7 @@
 
 Server::~Server()
 {
-    cancelAndDelete(failureMsg);
-    cancelAndDelete(recoveryMsg);
-    cancelAndDelete(electionTimeoutExpired);
-    cancelAndDelete(heartBeatsReminder);
-    cancelAndDelete(applyChangesMsg);
-    cancelAndDelete(leaderTransferFailed);
-    cancelAndDelete(minElectionTimeoutExpired);
-    cancelAndDelete(catchUpRoundTimeout);
-    cancelAndDelete(scheduleCrashMsg);
-    cancelAndDelete(voteReply);
-    cancelAndDelete(voteRequest);
-    cancelAndDelete(heartBeat);
-    cancelAndDelete(heartBeatResponse);
-    cancelAndDelete(logMessage);
-    cancelAndDelete(timeOutnow);
+    delete stateMachine;
 }
 
 void Server::initialize()
@@ -41,8 +27,6 @@ void Server::initialize()
     WATCH_VECTOR(nextIndex);
     WATCH_VECTOR(matchIndex);
     WATCH(logEntries);
-    WATCH(var_X);
-    WATCH(var_Y);
 
     numClient = getParentModule()->par("numClient");
     numServer = getParentModule()->par("numServer");
@@ -53,6 +37,42 @@ void Server::initialize()
     maxElectionTimeout = par("maxElectionTimeout");
     applyChangesPeriod = par("applyChangePeriod");
     heartbeatsPeriod = par("heartbeatsPeriod");
+    maxEntriesPerAppend = par("maxEntriesPerAppend");
+    maxAppendBytes = par("maxAppendBytes");
+    pipelineAppends = par("pipelineAppends");
+    maxInflightAppends = par("maxInflightAppends");
+    appendTimeout = par("appendTimeout");
+    eagerReplication = par("eagerReplication");
+    replicationDelay = par("replicationDelay");
+    suppressHeartbeats = par("suppressHeartbeats");
+    suppressedHeartbeats = 0;
+    snapshotThreshold = par("snapshotThreshold");
+    readIndexReads = par("readIndexReads");
+    sessionTTL = par("sessionTTL");
+    lastAppliedEntryTime = 0;
+    expiredSessions = 0;
+    leaseReads = par("leaseReads");
+    leaseDriftBound = par("leaseDriftBound");
+    leaseReadsServed = 0;
+    followerReads = par("followerReads");
+    followerReadsServed = 0;
+    readRoundCounter = 0;
+    readRoundInFlight = 0;
+    lastConfirmedReadRound = 0;
+    readRoundsStarted = 0;
+    readIndexReadsServed = 0;
+    maxApplyBatch = par("maxApplyBatch");
+    maxProposalBatch = par("maxProposalBatch");
+    proposalBatchDelay = par("proposalBatchDelay");
+    proposalBatches = 0;
+    batchedProposals = 0;
+    persistentLog = par("persistentLog");
+    walGroupCommitDelay = par("walGroupCommitDelay");
+    preVote = par("preVote");
+    checkQuorum = par("checkQuorum");
+    quorumStepdowns = 0;
+    preVoteRounds = 0;
+    electionsStarted = 0;
 
     currentTerm = 1;
     lastVotedTerm = 0;
@@ -63,10 +83,16 @@ void Server::initialize()
     leaderAddress = -1;
 
     networkAddress = gate("gateServer$i", 0)->getPreviousGate()->getIndex();
-    initializeRequestTable(4);
+    requestTable.clear();
     initializeConfiguration();
-    var_X = 1;
-    var_Y = 1;
+    if (persistentLog)
+    {
+        // one write-ahead log file per server
+        string walDirectory = par("walDirectory").stdstringValue();
+        wal.open(walDirectory + "/" + getFullName() + ".wal");
+        logSegments.open(walDirectory + "/" + getFullName() + ".seg", par("logSegmentEntries"));
+    }
+    stateMachine = createStateMachine(par("stateMachine").stdstringValue());
     numberVotingMembers = configuration.size();
 
     catchUpPhaseRunning = false;
@@ -77,67 +103,82 @@ void Server::initialize()
     {
         nextIndex.push_back(0);
         matchIndex.push_back(-1);
+        inflightAppends.push_back(vector<inflight_append>());
     }
 
     // INITIALIZE AUTOMESSAGES
-    failureMsg = new cMessage("Failure Msg");
-    minElectionTimeoutExpired = new cMessage("MinElectionTimeoutExpired");
-    heartBeatsReminder = new cMessage("heartBeatsReminder");
-    recoveryMsg = new cMessage("Recovery Msg");
-    leaderTransferFailed = new cMessage("LeaderTransferFailed");
-    catchUpRoundTimeout = new cMessage("CatchUpRoundTimeout");
-
-    electionTimeoutExpired = new cMessage("ElectionTimeoutExpired");
+    failureMsg = createTimer("Failure Msg");
+    minElectionTimeoutExpired = createTimer("MinElectionTimeoutExpired");
+    heartBeatsReminder = createTimer("heartBeatsReminder");
+    replicateEntriesMsg = createTimer("ReplicateEntries");
+    proposalBatchMsg = createTimer("AppendProposalBatch");
+    applyBatchMsg = createTimer("ApplyCommittedEntries");
+    readIndexTimeout = createTimer("ReadIndexRequestTimeout");
+    walFlushMsg = createTimer("WriteAheadLogFlush");
+    recoveryMsg = createTimer("Recovery Msg");
+    leaderTransferFailed = createTimer("LeaderTransferFailed");
+    catchUpRoundTimeout = createTimer("CatchUpRoundTimeout");
+    checkQuorumMsg = createTimer("CheckQuorum");
+
+    electionTimeoutExpired = createTimer("ElectionTimeoutExpired");
     double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
-    scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
+    startTimer(electionTimeoutExpired, randomTimeout);
 
-    applyChangesMsg = new cMessage("ApplyChangesToFiniteStateMachine");
-    scheduleAt(simTime() + applyChangesPeriod, applyChangesMsg);
+    applyChangesMsg = createTimer("ApplyChangesToFiniteStateMachine");
+    startTimer(applyChangesMsg, applyChangesPeriod);
 
-    scheduleCrashMsg = new cMessage("Schedule next crash");
-    scheduleAt(simTime(), scheduleCrashMsg);
+    scheduleCrashMsg = createTimer("Schedule next crash");
+    startTimer(scheduleCrashMsg, 0);
 
 }
 
+// MESSAGE DISPATCH: handler of each message kind (MessageKinds.h), nullptr for the kinds a server never receives
+const Server::message_handler Server::messageHandlers[MESSAGE_KINDS] = {
+    nullptr,                            // autoMessages
+    &Server::handleVoteRequest,         // VOTE_REQUEST_KIND
+    &Server::handleVoteReply,           // VOTE_REPLY_KIND
+    &Server::handleHeartBeat,           // HEARTBEAT_KIND
+    &Server::handleHeartBeatResponse,   // HEARTBEAT_RESPONSE_KIND
+    &Server::handleLogMessage,          // LOG_MESSAGE_KIND
+    nullptr,                            // LOG_MESSAGE_RESPONSE_KIND
+    &Server::handleTimeOutNow,          // TIMEOUT_NOW_KIND
+    &Server::handleInstallSnapshot,     // INSTALL_SNAPSHOT_KIND
+    &Server::handleReadIndexRequest,    // READ_INDEX_REQUEST_KIND
+    &Server::handleReadIndexResponse,   // READ_INDEX_RESPONSE_KIND
+    nullptr,                            // LEADER_ELECTION_KIND
+    nullptr,                            // PING_KIND
+    &Server::handlePreVoteRequest,      // PRE_VOTE_REQUEST_KIND
+    &Server::handlePreVoteReply         // PRE_VOTE_REPLY_KIND
+};
+
 void Server::handleMessage(cMessage *msg)
 {
-    voteReply = dynamic_cast<VoteReply *>(msg);
-    voteRequest = dynamic_cast<VoteRequest *>(msg);
-    heartBeat = dynamic_cast<HeartBeats *>(msg);
-    heartBeatResponse = dynamic_cast<HeartBeatResponse *>(msg);
-    logMessage = dynamic_cast<LogMessage *>(msg);
-    timeOutnow = dynamic_cast<TimeOutNow *>(msg);
-
     // ############################################### AUTO SHUTDOWN ###############################################
 
     if ((!gate("gateServer$o",0)->isConnected()) or (!gate("gateServer$i",0)->isConnected())){
         cDisplayString &dispStr = getDisplayString();
         dispStr.parse("i=device/server2,purple");
-        cancelEvent(failureMsg);
-        cancelEvent(recoveryMsg);
-        cancelEvent(electionTimeoutExpired);
-        cancelEvent(heartBeatsReminder);
-        cancelEvent(applyChangesMsg);
-        cancelEvent(leaderTransferFailed);
-        cancelEvent(minElectionTimeoutExpired);
-        cancelEvent(applyChangesMsg);
-        cancelEvent(catchUpRoundTimeout);
-        cancelEvent(scheduleCrashMsg);
-        voteReply = nullptr;
-        voteRequest = nullptr;
-        heartBeat = nullptr;
-        heartBeatResponse = nullptr;
-        logMessage = nullptr;
-        timeOutnow = nullptr;
+        stopTimer(failureMsg);
+        stopTimer(recoveryMsg);
+        stopTimer(electionTimeoutExpired);
+        // no leader state survives the loss of the link
+        stopLeading();
+        stopTimer(applyBatchMsg);
+        stopTimer(walFlushMsg);
+        stopTimer(applyChangesMsg);
+        stopTimer(leaderTransferFailed);
+        stopTimer(minElectionTimeoutExpired);
+        stopTimer(catchUpRoundTimeout);
+        stopTimer(scheduleCrashMsg);
         currentTerm = -1;
         numberVoteReceived = 0;
         serverState = FOLLOWER;
         char buf[10];
         string logEntriesFormat = "";
-        logEntriesFormat = logEntriesFormat + "currentTerm: %ld\n commitIndex: %ld\n  X==%ld; Y==%ld";
+        logEntriesFormat = logEntriesFormat + "currentTerm: %ld\n commitIndex: %ld\n  " + stateMachine->describe();
         char * cstr = new char [logEntriesFormat.length() + 1];
         strcpy(cstr, logEntriesFormat.c_str());
-        sprintf(buf, cstr, currentTerm, commitIndex, var_X, var_Y);
+        sprintf(buf, cstr, currentTerm, commitIndex);
         getDisplayString().setTagArg("t", 0, buf);
     }
     else
@@ -147,27 +188,45 @@ void Server::handleMessage(cMessage *msg)
         if(msg == failureMsg)
         {
             bubble("CRASHED");
-            cancelEvent(failureMsg);
-            cancelEvent(recoveryMsg);
-            cancelEvent(electionTimeoutExpired);
-            cancelEvent(heartBeatsReminder);
-            cancelEvent(applyChangesMsg);
-            cancelEvent(leaderTransferFailed);
-            cancelEvent(minElectionTimeoutExpired);
-            cancelEvent(catchUpRoundTimeout);
+            stopTimer(failureMsg);
+            stopTimer(recoveryMsg);
+            stopTimer(electionTimeoutExpired);
+            stopTimer(applyBatchMsg);
+            stopTimer(walFlushMsg);
+            stopTimer(applyChangesMsg);
+            stopTimer(leaderTransferFailed);
+            stopTimer(minElectionTimeoutExpired);
+            stopTimer(catchUpRoundTimeout);
+            // the pending reads are lost with the crash: nobody is answered
+            pendingReads.clear();
+            // the proposals not yet appended are lost too
+            stopLeading();
+            if (persistentLog)
+            {
+                // everything not yet flushed to the write-ahead log is lost, together with the messages waiting for it
+                wal.discardPendingWrites();
+                for (int i = 0; i < pendingDurableMsgs.size(); i++)
+                {
+                    delete pendingDurableMsgs[i];
+                }
+                pendingDurableMsgs.clear();
+            }
             cDisplayString &dispStr = getDisplayString();
             dispStr.parse("i=device/server2,red");
             crashed = true;
             double randomFailureTime = uniform(0.5, maxCrashDuration);
             EV
             << "\nServer ID: [" + to_string(getIndex(networkAddress)) + "] is dead for about: [" + to_string(randomFailureTime) + "]\n";
-            recoveryMsg = new cMessage("recoveryMsg");
-            scheduleAt(simTime() + randomFailureTime, recoveryMsg);
+            startTimer(recoveryMsg, randomFailureTime);
         }
 
         if (msg == recoveryMsg)
         {
             crashed = false;
+            if (persistentLog)
+            {
+                recoverFromWriteAheadLog();
+            }
             EV << "Here is server[" + to_string(getIndex(networkAddress)) + "]: I am no more dead... \n";
             bubble("I'm back!");
             cDisplayString &dispStr = getDisplayString();
@@ -178,11 +237,12 @@ void Server::handleMessage(cMessage *msg)
                 dispStr.parse("i=device/server2,bronze");
                 serverState = FOLLOWER;
                 numberVoteReceived = 0;
-                acceptVoteRequest = true;
+                // a lease granted before the crash may still be running: no vote, and no election,
+                // before minElectionTimeout
+                startAcceptVoteRequestCountdown();
                 // restart election count-down
-                electionTimeoutExpired = new cMessage("NewElectionTimeoutExpired");
                 double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
-                scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
+                startTimer(electionTimeoutExpired, randomTimeout);
                 // restart the periodical updates of the FSM
 
             }
@@ -196,13 +256,11 @@ void Server::handleMessage(cMessage *msg)
                 catchUpPhaseRunning = false;
                 leaderTransferPhase = false;
                 last_req* lastReqHashEntry = getLastRequest(changingServerEntry.clientAddress);
-                lastReqHashEntry->lastArrivedSerial--;
+                forgetSerial(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, changingServerEntry.serialNumber);
             }
-            applyChangesMsg = new cMessage("Apply changes to State Machine");
-            scheduleAt(simTime() + applyChangesPeriod, applyChangesMsg);
+            startTimer(applyChangesMsg, applyChangesPeriod);
             // Schedule next crashes
-            scheduleCrashMsg = new cMessage("Schedule next crash");
-            scheduleAt(simTime(), scheduleCrashMsg);
+            startTimer(scheduleCrashMsg, 0);
         }
 
         else if (crashed)
@@ -213,11 +271,21 @@ void Server::handleMessage(cMessage *msg)
         // ################################################ NORMAL BEHAVIOUR ################################################
         else if (crashed == false)
         {
+            ////
+            // MESSAGE RECEIVED FROM ANOTHER MODULE: a single call to the handler of its kind
+            if (!msg->isSelfMessage())
+            {
+                dispatchMessage(msg);
+            }
+
             ////
             // ELECTION TIMEOUT IS EXPIRED, START A NEW ELECTION
             if (msg == electionTimeoutExpired and serverState != LEADER and serverState != NON_VOTING_MEMBER)
             {
-                startNewElection(false);
+                if (preVote)
+                    startPreVote();
+                else
+                    startNewElection(false);
             }
 
             else if (msg == scheduleCrashMsg)
@@ -226,16 +294,14 @@ void Server::handleMessage(cMessage *msg)
                 if (crashProbabilitySample < serverCrashProbability)
                 {
                     double randomDelay = uniform(1, maxCrashDelay);
-                    failureMsg = new cMessage("failureMsg");
                     EV
                     << "Here is server" + to_string(getIndex(networkAddress)) + ": I will crash in " + to_string(randomDelay) + " seconds...\n";
-                    scheduleAt(simTime() + randomDelay, failureMsg);
+                    startTimer(failureMsg, randomDelay);
                 }
                 else
                 {
-                    scheduleCrashMsg = new cMessage("Schedule next crash");
                     double randomTimeout = uniform(0, maxCrashDelay);
-                    scheduleAt(simTime() + randomTimeout, scheduleCrashMsg);
+                    startTimer(scheduleCrashMsg, randomTimeout);
                 }
             }
 
@@ -245,350 +311,6 @@ void Server::handleMessage(cMessage *msg)
                 catchUpCountdownEnded = true;
             }
 
-            ////
-            // VOTE REQUEST RECEIVED
-            else if (voteRequest != nullptr
-                    &&
-                    (acceptVoteRequest or voteRequest->getDisruptLeaderPermission())
-                    &&
-                    serverState != NON_VOTING_MEMBER)
-            {
-                int candidateAddress = voteRequest->getCandidateAddress();
-                int candidateTerm = voteRequest->getCurrentTerm();
-                int candidateLastLogTerm = voteRequest->getLastLogTerm();
-                int candidateLastLogIndex = voteRequest->getLastLogIndex();
-                int thisLastLogIndex = logEntries.size() - 1;
-                int thisLastLogTerm = 0;
-                if (!(thisLastLogIndex < 0))
-                {
-                    thisLastLogTerm = logEntries[thisLastLogIndex].entryTerm;
-                }
-                bool candidateLogUpToDate = true;
-
-                if (candidateTerm > currentTerm)
-                {
-                    // STEPDOWN PROCEDURE
-                    stepdown(voteRequest->getCurrentTerm());
-                    if (leaderTransferPhase)
-                    {
-                        cancelEvent(leaderTransferFailed);
-                        leaderTransferPhase = false;
-                        timeOutNowSent = false;
-                    }
-                }
-
-                if (candidateLastLogTerm < thisLastLogTerm
-                        or (candidateLastLogTerm == thisLastLogTerm and candidateLastLogIndex < thisLastLogIndex))
-                {
-                    candidateLogUpToDate = false;
-                }
-
-                if (candidateTerm == currentTerm && candidateTerm > lastVotedTerm && candidateLogUpToDate)
-                {
-                    cancelEvent(electionTimeoutExpired);
-                    // i can grant up to 1 vote for each term
-                    lastVotedTerm = voteRequest->getCurrentTerm();
-                    // restart new election count-down
-                    electionTimeoutExpired = new cMessage("NewElectionTimeoutExpired");
-                    double randomTimeout = uniform(1, 2);
-                    scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
-                    // send positive vote reply
-                    bubble("vote reply: vote granted");
-                    VoteReply *voteReply = new VoteReply("voteReply");
-                    voteReply->setVoterAddress(networkAddress); // this is the id of the voting server
-                    voteReply->setLeaderAddress(candidateAddress);
-                    voteReply->setVoteGranted(1);
-                    voteReply->setCurrentTerm(currentTerm);
-                    if(gate("gateServer$o", 0)->isConnected())
-                        send(voteReply, "gateServer$o", 0);
-                }
-                else
-                {
-                    // send negative vote reply
-                    bubble("vote reply: NO");
-                    VoteReply *voteReply = new VoteReply("voteReply");
-                    voteReply->setVoterAddress(networkAddress); // this is the id of the voting server
-                    voteReply->setLeaderAddress(candidateAddress);
-                    voteReply->setVoteGranted(0);
-                    voteReply->setCurrentTerm(currentTerm);
-                    if(gate("gateServer$o", 0)->isConnected())
-                        send(voteReply, "gateServer$o", 0);
-                }
-            }
-
-            else if (voteReply != nullptr)
-            { // here i received a vote so i increment the current term vote
-
-                if (voteReply->getCurrentTerm() > currentTerm)
-                {
-                    // STEPDOWN PROCEDURE
-                    stepdown(voteReply->getCurrentTerm());
-                }
-
-                if (voteReply->getCurrentTerm() == currentTerm && serverState == CANDIDATE)
-                {
-                    numberVoteReceived = numberVoteReceived + voteReply->getVoteGranted();
-                    if (numberVoteReceived > numberVotingMembers / 2)
-                    {
-                        // Majority is reached: i am the NEW LEADER
-                        bubble("i'm the leader");
-                        cDisplayString &dispStr = getDisplayString();
-                        dispStr.parse("i=device/server2,gold");
-
-                        // if a server becomes leader I have to cancel the timer for a new election since it will
-                        // remain leader until the first failure, furthermore i have to reset all state variables, including nextIdex and matchIndex
-                        cancelEvent(electionTimeoutExpired);
-                        serverState = LEADER;
-                        leaderAddress = networkAddress;
-                        numberVoteReceived = 0;
-                        catchUpPhaseRunning = false;
-                        for (int serverIndex = 0; serverIndex < nextIndex.size(); serverIndex++)
-                        {
-                            nextIndex[serverIndex] = logEntries.size();
-                            if (serverIndex != networkAddress)
-                            {
-                                matchIndex[serverIndex] = -1;
-                            }
-                            else
-                            {
-                                matchIndex[serverIndex] = logEntries.size() - 1;
-                            }
-                        }
-
-                        if(!leaderTransferPhase)
-                        {
-                            // add NOP to log
-                            log_entry NOP;
-                            NOP.clientAddress = NO_CLIENT;
-                            NOP.entryTerm = currentTerm;
-                            NOP.operandName = 'X';
-                            NOP.operandValue = 0;
-                            NOP.operation = 'A';
-                            NOP.entryLogIndex = logEntries.size();
-                            // update next index and match index for leader.
-                            nextIndex[getIndex(networkAddress)]++;
-                            matchIndex[getIndex(networkAddress)]++;
-                            logEntries.push_back(NOP);
-                            // periodical HeartBeat
-
-                        }
-                        else
-                        {
-                            log_entry REMOVE;
-                            REMOVE.clientAddress = changingServerEntry.clientAddress;
-                            REMOVE.entryTerm = currentTerm;
-                            REMOVE.entryLogIndex = logEntries.size();
-                            REMOVE.addressServerToRemove = changingServerEntry.addressServerToRemove;
-                            // update next index and match index for leader.
-                            nextIndex[getIndex(networkAddress)]++;
-                            matchIndex[getIndex(networkAddress)]++;
-                            logEntries.push_back(REMOVE);
-                            int toRemove = REMOVE.addressServerToRemove;
-                            configuration.erase(remove(configuration.begin(), configuration.end(), toRemove));
-                        }
-                        heartBeatsReminder = new cMessage("heartBeatsReminder");
-                        scheduleAt(simTime(), heartBeatsReminder);
-                    }
-                }
-                leaderTransferPhase = false;
-            }
-
-            ////
-            // HEARTBEAT RECEIVED (AppendEntries RPC)
-            if (heartBeat != nullptr)
-            {
-                int logSize = logEntries.size();
-                int lastLogIndex = logSize - 1;
-                int term = heartBeat->getLeaderCurrentTerm();
-                int prevLogIndex = heartBeat->getPrevLogIndex();
-                int prevLogTerm = heartBeat->getPrevLogTerm();
-                int leaderCommit = heartBeat->getLeaderCommit();
-                int clientAddr = heartBeat->getEntry().clientAddress;
-                bool condition2Satisfied = true;
-                last_req* lastRequestFromClient;
-
-                if (serverState == NON_VOTING_MEMBER && heartBeat->getEmpty())
-                {
-                    catchUpTargetIndex = heartBeat->getLeaderCommit();
-                }
-
-                /* ****************
-                 * LOG IS REFUSED *
-                 ******************/
-                // ALL SERVERS: If RPC request or response contains term > currentTerm: set currentTerm = term, convert to follower
-                if (term < currentTerm)
-                {
-                    // @ensure LOG MATCHING PROPERTY
-                    // CONSISTENCY CHECK: (1) Reply false if term < currentTerm
-                    rejectLog(leaderAddress);
-                }
-                else
-                {
-                    // CONDITION (1) satisfied
-                    currentTerm = term;
-                    if(serverState != NON_VOTING_MEMBER)
-                    {
-                        cDisplayString &dispStr = getDisplayString();
-                        dispStr.parse("i=device/server2, bronze");
-                        serverState = FOLLOWER;
-                    }
-                    numberVoteReceived = 0;
-                    // alreadyVoted = false;
-                    leaderAddress = heartBeat->getLeaderAddress();
-                    // (2) Reply false if log doesn't contain an entry at prevLogIndex...
-                    // whose term matches prevLogTerm
-                    // (2.a) Log is too short
-                    if (prevLogIndex > lastLogIndex)
-                    {
-                        condition2Satisfied = false;
-                    }
-                    // (2.b) no entry at prevLogIndex whose term matches prevLogTerm
-                    if (logSize > 0 and prevLogIndex >= 0)
-                    {
-                        // if logEntries is empty (size == 0) or prevLogTerm == -1 there is no need to deny
-                        if (logEntries[prevLogIndex].entryTerm != prevLogTerm)
-                        {
-                            condition2Satisfied = false;
-                        }
-
-                    }
-                    if (condition2Satisfied)
-                    {
-                        /*******************
-                         * LOG IS ACCEPTED *
-                         *******************/
-                        leaderAddress = heartBeat->getLeaderAddress();
-                        int newEntryIndex = heartBeat->getEntry().entryLogIndex;
-                        // CASE A: heartbeat DOES NOT CONTAIN ANY ENTRY, the follower
-                        //         replies to confirm consistency with leader's log
-                        if (heartBeat->getEmpty())
-                        {
-                            if (leaderCommit > commitIndex)
-                            {
-                                commitIndex = min(leaderCommit, prevLogIndex); // no new entries in the message: we can guarantee consistency up to prevLogIndex
-                            }
-                            acceptLog(leaderAddress, prevLogIndex);
-                        }
-                        else
-                        {
-                            // CASE B: heartbeat delivers a new entry for follower's log
-                            // @ensure CONSISTENCY WITH SEVER LOG UP TO prevLogIndex
-                            // No entry at newEntryIndex, simply append the new entry
-                            if (lastLogIndex < newEntryIndex)
-                            {
-                                logEntries.push_back(heartBeat->getEntry());
-                            }
-                            // @ensure (3): if an existing entry conflicts with a new one (same index but different terms),
-                            //              delete the existing entry and all that follow it
-                            // Conflicting entry at newEntryIndex, delete the last entries up to newEntryIndex, then append the new entry
-                            else if (logEntries[newEntryIndex].entryTerm != term)
-                            {
-                                int to_erase = logSize - newEntryIndex;
-                                logEntries.erase(logEntries.end() - to_erase, logEntries.end());
-                                logEntries.push_back(heartBeat->getEntry());
-                            }
-                            // client request index = index of last the entry. Ignore NOPs
-                            if (clientAddr != NO_CLIENT)
-                            {
-                                lastRequestFromClient = getLastRequest(clientAddr);
-                                if(lastRequestFromClient == nullptr)
-                                {
-                                    lastRequestFromClient = addNewRequestEntry(clientAddr);
-                                }
-                                lastRequestFromClient->lastLoggedIndex = logEntries.size() - 1;
-                            }
-                            // CONFIGURATION CHANGE
-                            // ADD SERVER
-                            int toAdd = heartBeat->getEntry().addressServerToAdd;
-                            if(toAdd >= 0 && !(*find(configuration.begin(), configuration.end(), toAdd) == toAdd))
-                            {
-                                configuration.push_back(heartBeat->getEntry().addressServerToAdd);
-                                // if a new server arrives for the first time, then extend nextIndex and matchIndex
-                                if(not(heartBeat->getEntry().operandValue < nextIndex.size()))
-                                {
-                                    nextIndex.push_back(0);
-                                    matchIndex.push_back(-1);
-                                }
-                            }
-                            // REMOVE SERVER
-                            else if (heartBeat->getEntry().addressServerToRemove >= 0)
-                            {
-                                int toRemove = heartBeat->getEntry().addressServerToRemove;
-                                configuration.erase(remove(configuration.begin(), configuration.end(), toRemove), configuration.end());
-                            }
-
-                            if(serverState == NON_VOTING_MEMBER && heartBeat->getLeaderCommit() == catchUpTargetIndex)
-                            {
-                                // become follower
-                                stepdown(heartBeat->getLeaderCurrentTerm());
-                            }
-                            /* NOTE: if a replica receives the same entry twice, it simply ignores the second one and sends an ACK.
-                             * @ensure (5) If leaderCommit > commitIndex, set commitIndex = min(leaderCommit, index of last new entry)
-                             * index of last */
-                            acceptLog(leaderAddress, newEntryIndex);
-                            if (leaderCommit > commitIndex)
-                            {
-                                commitIndex = min(leaderCommit, newEntryIndex);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        rejectLog(leaderAddress);
-                        restartCountdown();
-                    }
-                }
-                startAcceptVoteRequestCountdown();
-                restartCountdown();
-            }
-
-            ////
-            // RECEIVED RESPONSE FROM A FOLLOWER
-            if (heartBeatResponse != nullptr)
-            {
-                int followerAddr = heartBeatResponse->getFollowerAddress();
-                int followerIndex = getIndex(followerAddr);
-                int followerLogLength = heartBeatResponse->getLogLength();
-                int followerMatchIndex = heartBeatResponse->getMatchIndex();
-                if (heartBeatResponse->getSucceded())
-                {
-                    // heartBeat accepted
-                    matchIndex[followerIndex] = followerMatchIndex;
-                    nextIndex[followerIndex] = matchIndex[followerIndex] + 1;
-
-                    // catch up phase round ends
-                    if (catchUpPhaseRunning && followerAddr == changingServerEntry.addressServerToAdd && matchIndex[followerIndex] == catchUpTargetIndex)
-                    {
-                        endCatchUpRound();
-                    }
-                }
-                else
-                {
-                    if (heartBeatResponse->getTerm() > currentTerm)
-                    {
-                        cancelEvent(heartBeatsReminder);
-                        cancelEvent(electionTimeoutExpired);
-                        currentTerm = heartBeatResponse->getTerm();
-                        electionTimeoutExpired = new cMessage("START ELECTION NOW TO BREAK A STUCK PHASE");
-                        startNewElection(false);
-                    }
-                    else if (followerLogLength < nextIndex[followerIndex])
-                    {
-                        // heartBeat rejected
-                        nextIndex[followerIndex] = followerLogLength;
-                    }
-                    else
-                    {
-                        if (nextIndex[followerIndex] > 0)
-                        {
-                            nextIndex[followerIndex] = nextIndex[followerIndex] - 1;
-                        }
-                    }
-                }
-                updateCommitIndexOnLeader();
-                startAcceptVoteRequestCountdown();
-            }
-
             ////
             // SUFFICIENT TIME IS PASSED, VOTE REQUESTS CAN BE ACCEPTED
             if (msg == minElectionTimeoutExpired)
@@ -598,132 +320,22 @@ void Server::handleMessage(cMessage *msg)
 
             ////
             // APPLY CHANGES TO FSM BY EXECUTING OPERATIONS IN THE LOG
+            // the entries are normally applied as soon as they are committed (applyBatchMsg),
+            // this periodic pass is only a fallback
             if (msg == applyChangesMsg)
             {
-                int applyNextIndex;
-                if(lastApplied < commitIndex)
-                {
-                    for (applyNextIndex = lastApplied + 1 ; commitIndex > lastApplied; applyNextIndex++)
-                    {
-                        log_entry nextToApply = logEntries[applyNextIndex];
-                        updateState(nextToApply);
-                        // update table, but ignore the NOP
-                        if(nextToApply.clientAddress != NO_CLIENT)
-                            getLastRequest(nextToApply.clientAddress)->lastAppliedSerial = nextToApply.serialNumber;
-                        lastApplied++;
-                    }
-                }
-                applyChangesMsg = new cMessage("Apply changes to State Machine");
-                scheduleAt(simTime() + applyChangesPeriod, applyChangesMsg);
+                applyCommittedEntries();
+                startTimer(applyChangesMsg, applyChangesPeriod);
             }
 
             ////
-            // LOG MESSAGE REQUEST RECEIVED, it is ignored only if leader transfer process is going on
-            if (logMessage != nullptr && !leaderTransferPhase && leaderAddress >= 0)
+            // THE LEADER DID NOT ANSWER: the clients will retry
+            if (msg == readIndexTimeout)
             {
-                int serialNumber = logMessage->getSerialNumber();
-                int clientAddress = logMessage->getClientAddress();
-                bool alreadyReceived = false;
-                last_req* lastReqHashEntry = getLastRequest(clientAddress);
-
-                if (lastReqHashEntry != nullptr)
-                {
-                    int lastSerial = lastReqHashEntry->lastArrivedSerial;
-                    // verify whether the entry was already received or not
-                    if(lastSerial >= serialNumber)
-                    {
-                        alreadyReceived = true;
-                    }
-                }
-                else
-                {
-                    // first message from the client: add an entry to the table
-                    lastReqHashEntry = addNewRequestEntry(clientAddress);
-                }
-                lastReqHashEntry->lastArrivedSerial = logMessage->getSerialNumber();
-
-                if (alreadyReceived)
-                {
-                    int index = lastReqHashEntry->lastLoggedIndex;
-                    // message already received
-                    if(index > commitIndex)
-                    {
-                        // NACK: request yet to commit
-                        bubble("This request is already in the log, but it is still uncommitted");
-                        sendResponseToClient(clientAddress, serialNumber, false, false);
-                    }
-                    else if (logEntries[index].clientAddress == logMessage->getClientAddress() and logEntries[index].serialNumber >= serialNumber)
-                    {
-                        // ACK: request has already been committed
-                        bubble("This request has already been committed!");
-                        sendResponseToClient(clientAddress, serialNumber, true, false);
-                    }
-                    else if (networkAddress != leaderAddress)
-                    {
-                        // Redirect to leader in case the message is received by a follower.
-                        sendResponseToClient(clientAddress, serialNumber, false, true);
-                    }
-                }
-                else
-                {
-                    // new message
-                    if (networkAddress != leaderAddress)
-                    {
-                        // Redirect to leader in case the message is received by a follower.
-                        sendResponseToClient(clientAddress, serialNumber, false, true);
-                    }
-                    else
-                    {
-                        // once a log message is received a new log entry is added in the leader node
-                        log_entry newEntry;
-                        newEntry.clientAddress = logMessage->getClientAddress();
-                        newEntry.entryTerm = currentTerm;
-                        newEntry.operandName = logMessage->getOperandName();
-                        newEntry.operandValue = logMessage->getOperandValue();
-                        newEntry.operation = logMessage->getOperation();
-                        newEntry.serialNumber = logMessage->getSerialNumber();
-                        newEntry.addressServerToAdd = logMessage->getServerToAdd();
-                        newEntry.addressServerToRemove = logMessage->getServerToRemove();
-                        newEntry.entryLogIndex = logEntries.size();
-                        if (logMessage->getServerToRemove() < 0 and logMessage->getServerToAdd() < 0)
-                        {
-                            // ordinary entry
-                            // update next index and match index for leader.
-                            nextIndex[getIndex(networkAddress)]++;
-                            matchIndex[getIndex(networkAddress)]++;
-                            logEntries.push_back(newEntry);
-                            // update last received index
-                            lastReqHashEntry->lastLoggedIndex = newEntry.entryLogIndex;
-                        }
-                        else if (commitIndex >= 0  and logEntries[commitIndex].entryTerm == currentTerm)
-                        {
-                            // change configuration entry
-                            // but only accept the request if some entry has been committed in the current term
-                            startMembershipChangeProcedure(newEntry);
-                        }
-                        else
-                        {
-                            lastReqHashEntry->lastArrivedSerial--;
-                        }
-                    }
-                }
+                failPendingReads();
             }
         }
 
-        ////
-        // FORCED TIMEOUT MESSAGE DUE TO LEADER TRANSFER
-        if (timeOutnow != nullptr)
-        {
-            leaderTransferPhase = true;
-            log_entry rm_serv ;
-            rm_serv.addressServerToRemove = timeOutnow->getServerToRemove();
-            rm_serv.clientAddress = timeOutnow->getClientAddress();
-            rm_serv.serialNumber = timeOutnow->getSerialNumber();
-            changingServerEntry = rm_serv;
-            cancelEvent(electionTimeoutExpired);
-            startNewElection(true);
-        }
-
         ////
         // ABORT LEADER TRANSFER PROCESS
         if (msg == leaderTransferFailed)
@@ -734,7 +346,7 @@ void Server::handleMessage(cMessage *msg)
             timeOutNowSent = false;
             // before sending the NACK the leader decrement the value of the last request entry so that it can be processed again
             last_req* lastReqHashEntry = getLastRequest(changingServerEntry.clientAddress);
-            lastReqHashEntry->lastArrivedSerial--;
+            forgetSerial(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, changingServerEntry.serialNumber);
             // NACK
             int managerAddr = changingServerEntry.clientAddress;
             int serial = changingServerEntry.serialNumber;
@@ -743,11 +355,9 @@ void Server::handleMessage(cMessage *msg)
 
         ////
         // SEND HEARTBEAT (AppendEntries RPC)
-        if (msg == heartBeatsReminder)
+        if (msg == heartBeatsReminder and serverState == LEADER)
         {
-            int logSize = logEntries.size();
-            int lastLogIndex = logSize - 1;
-            int nextLogIndex;
+            int lastLogIndex = getLastLogIndex();
             int followerAddr;
             int followerIndex;
             vector<int> toUpdate = configuration;
@@ -759,72 +369,1317 @@ void Server::handleMessage(cMessage *msg)
             {
                 followerAddr = toUpdate[i];
                 followerIndex = getIndex(followerAddr);
-                HeartBeats *RPCAppendEntriesMsg = new HeartBeats("i'm the leader");
                 // to avoid message to client and self message
                 if (followerAddr != this->networkAddress)
                 {
-                    nextLogIndex = nextIndex[followerIndex];
-                    RPCAppendEntriesMsg->setLeaderAddress(networkAddress);
-                    RPCAppendEntriesMsg->setDestAddress(followerAddr);
-                    RPCAppendEntriesMsg->setLeaderCurrentTerm(currentTerm);
-                    RPCAppendEntriesMsg->setLeaderCommit(commitIndex);
-                    RPCAppendEntriesMsg->setPrevLogIndex(nextLogIndex - 1);
-                    // leader's log not empty
-                    if (nextLogIndex == 0 )
+                    // PIPELINING: the oldest in-flight append was not acknowledged in time, roll back and resend it
+                    if (pipelineAppends && !inflightAppends[followerIndex].empty()
+                            && simTime() - inflightAppends[followerIndex].front().sendTime > appendTimeout)
                     {
-                        RPCAppendEntriesMsg->setPrevLogTerm(1);
+                        nextIndex[followerIndex] = inflightAppends[followerIndex].front().firstIndex;
+                        inflightAppends[followerIndex].clear();
                     }
-                    else
+                    // follower's log up to date
+                    if (nextIndex[followerIndex] > lastLogIndex && leaderTransferPhase && !timeOutNowSent)
                     {
-                        RPCAppendEntriesMsg->setPrevLogTerm(logEntries[nextLogIndex - 1].entryTerm);
+                        tryLeaderTransfer(followerAddr);
                     }
-
-                    if (nextLogIndex <= lastLogIndex)
+                    // HEARTBEAT SUPPRESSION: a recent AppendEntries already told the follower that the leader is alive
+                    if (!heartbeatNeeded(followerAddr))
                     {
-                        // follower's log needs an update
-                        RPCAppendEntriesMsg->setEntry(logEntries[nextLogIndex]);
-                        RPCAppendEntriesMsg->setEmpty(false);
+                        suppressedHeartbeats++;
+                        continue;
                     }
-                    // follower's log up to date
-                    else if (leaderTransferPhase && !timeOutNowSent)
+                    sendAppendEntries(followerAddr);
+                    // PIPELINING: fill the in-flight window without waiting for the responses
+                    while (pipelineAppends && nextIndex[followerIndex] <= lastLogIndex
+                            && inflightAppends[followerIndex].size() < maxInflightAppends)
                     {
-                        tryLeaderTransfer(followerAddr);
+                        sendAppendEntries(followerAddr);
                     }
-                    if(gate("gateServer$o", 0)->isConnected())
-                        send(RPCAppendEntriesMsg, "gateServer$o", 0);
                 }
             }
 
-            heartBeatsReminder = new cMessage("heartBeatsReminder");
-            scheduleAt(simTime() + heartbeatsPeriod, heartBeatsReminder);
+            startTimer(heartBeatsReminder, heartbeatsPeriod);
+        }
+
+        ////
+        // CHECK QUORUM: end of a window, the leader must have heard from a majority
+        if (msg == checkQuorumMsg)
+        {
+            checkLeaderQuorum();
+        }
+
+        ////
+        // APPLY ON COMMIT: apply the next batch of committed entries
+        if (msg == applyBatchMsg)
+        {
+            applyCommittedEntries();
+        }
+
+        ////
+        // GROUP COMMIT: make the pending records durable, then release the messages waiting for them
+        if (msg == walFlushMsg)
+        {
+            flushWriteAheadLog();
+        }
+
+        ////
+        // PROPOSAL BATCHING: the requests collected during the batching delay enter the log together
+        if (msg == proposalBatchMsg)
+        {
+            flushProposals();
+        }
+
+        ////
+        // EAGER REPLICATION: ship the entries appended during the coalescing delay without waiting for the next heartbeat
+        if (msg == replicateEntriesMsg && serverState == LEADER)
+        {
+            int lastLogIndex = getLastLogIndex();
+            vector<int> toUpdate = configuration;
+            if(catchUpPhaseRunning) {
+                toUpdate.push_back(changingServerEntry.addressServerToAdd);
+            }
+
+            for (int i = 0; i < toUpdate.size(); i++)
+            {
+                int followerAddr = toUpdate[i];
+                int followerIndex = getIndex(followerAddr);
+                // only followers that acknowledged everything sent so far: lagging ones are served by the heartbeats
+                bool upToDate;
+                if (pipelineAppends)
+                {
+                    upToDate = inflightAppends[followerIndex].size() < maxInflightAppends;
+                }
+                else
+                {
+                    upToDate = matchIndex[followerIndex] + 1 == nextIndex[followerIndex];
+                }
+                if (followerAddr != this->networkAddress && upToDate && nextIndex[followerIndex] <= lastLogIndex)
+                {
+                    sendAppendEntries(followerAddr);
+                }
+            }
         }
     }
+    // a term or a vote changed by this event is made durable with the next group commit,
+    // even if no message waits for it
+    if (persistentLog && !crashed && currentTerm >= 0)
+    {
+        persistTermAndVote();
+    }
+    // the received messages are not kept: the timers are owned by TimerModule
+    if (!msg->isSelfMessage())
+    {
+        delete msg;
+    }
 }
 
 
-void Server::acceptLog(int leaderAddress, int matchIndex)
+void Server::dispatchMessage(cMessage *msg)
 {
-    HeartBeatResponse *reply = new HeartBeatResponse("Consistency check: OK");
-    reply->setMatchIndex(matchIndex);
-    reply->setTerm(currentTerm);
-    reply->setSucceded(true);
-    reply->setLeaderAddress(leaderAddress);
-    reply->setFollowerAddress(networkAddress);
+    short kind = msg->getKind();
+    if (kind <= 0 or kind >= MESSAGE_KINDS or messageHandlers[kind] == nullptr)
+    {
+        EV << "Server: message " + string(msg->getName()) + " of unexpected kind " + to_string(kind) + " ignored\n";
+        return;
+    }
+    receivedMessages[kind]++;
+    (this->*messageHandlers[kind])(msg);
+}
+
+// VOTE REQUEST RECEIVED
+void Server::handleVoteRequest(cMessage *msg)
+{
+    VoteRequest *voteRequest = static_cast<VoteRequest *>(msg);
+    if (!(acceptVoteRequest or voteRequest->getDisruptLeaderPermission()) or serverState == NON_VOTING_MEMBER)
+    {
+        return;
+    }
+    int candidateAddress = voteRequest->getCandidateAddress();
+    int candidateTerm = voteRequest->getCurrentTerm();
+    bool logUpToDate = candidateLogUpToDate(voteRequest->getLastLogTerm(), voteRequest->getLastLogIndex());
+
+    if (candidateTerm > currentTerm)
+    {
+        // STEPDOWN PROCEDURE
+        stepdown(voteRequest->getCurrentTerm());
+        if (leaderTransferPhase)
+        {
+            stopTimer(leaderTransferFailed);
+            leaderTransferPhase = false;
+            timeOutNowSent = false;
+        }
+    }
+
+    if (candidateTerm == currentTerm && candidateTerm > lastVotedTerm && logUpToDate)
+    {
+        // i can grant up to 1 vote for each term
+        lastVotedTerm = voteRequest->getCurrentTerm();
+        // restart new election count-down
+        double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
+        startTimer(electionTimeoutExpired, randomTimeout);
+        // send positive vote reply
+        bubble("vote reply: vote granted");
+        VoteReply *voteReply = new VoteReply("voteReply");
+        voteReply->setVoterAddress(networkAddress); // this is the id of the voting server
+        voteReply->setLeaderAddress(candidateAddress);
+        voteReply->setVoteGranted(1);
+        voteReply->setCurrentTerm(currentTerm);
+        sendDurably(voteReply);
+    }
+    else
+    {
+        // send negative vote reply
+        bubble("vote reply: NO");
+        VoteReply *voteReply = new VoteReply("voteReply");
+        voteReply->setVoterAddress(networkAddress); // this is the id of the voting server
+        voteReply->setLeaderAddress(candidateAddress);
+        voteReply->setVoteGranted(0);
+        voteReply->setCurrentTerm(currentTerm);
+        sendDurably(voteReply);
+    }
+}
+
+// the candidate's log is at least as up-to-date as the log of this server
+bool Server::candidateLogUpToDate(int candidateLastLogTerm, int candidateLastLogIndex)
+{
+    int thisLastLogIndex = getLastLogIndex();
+    int thisLastLogTerm = getLogTerm(thisLastLogIndex);
+    return !(candidateLastLogTerm < thisLastLogTerm
+            or (candidateLastLogTerm == thisLastLogTerm and candidateLastLogIndex < thisLastLogIndex));
+}
+
+// PRE-VOTE REQUEST RECEIVED: the pre-vote is granted as the vote would be, but neither the term nor
+// lastVotedTerm change. It is refused while this server hears from a leader
+void Server::handlePreVoteRequest(cMessage *msg)
+{
+    PreVoteRequest *preVoteRequest = static_cast<PreVoteRequest *>(msg);
+    if (serverState == NON_VOTING_MEMBER)
+    {
+        return;
+    }
+    bool granted = acceptVoteRequest and serverState != LEADER
+            and preVoteRequest->getNextTerm() > currentTerm
+            and candidateLogUpToDate(preVoteRequest->getLastLogTerm(), preVoteRequest->getLastLogIndex());
+
+    PreVoteReply *preVoteReply = new PreVoteReply("preVoteReply");
+    preVoteReply->setVoterAddress(networkAddress);
+    preVoteReply->setCandidateAddress(preVoteRequest->getCandidateAddress());
+    preVoteReply->setNextTerm(preVoteRequest->getNextTerm());
+    preVoteReply->setCurrentTerm(currentTerm);
+    preVoteReply->setVoteGranted(granted);
     if(gate("gateServer$o", 0)->isConnected())
-        send(reply, "gateServer$o", 0);
+        send(preVoteReply, "gateServer$o", 0);
+}
+
+// PRE-VOTE REPLY RECEIVED: with a majority of pre-votes the real election starts
+void Server::handlePreVoteReply(cMessage *msg)
+{
+    PreVoteReply *preVoteReply = static_cast<PreVoteReply *>(msg);
+    if (preVoteReply->getCurrentTerm() > currentTerm)
+    {
+        // STEPDOWN PROCEDURE: the voter is already in a later term
+        preVotePhase = false;
+        stepdown(preVoteReply->getCurrentTerm());
+        return;
+    }
+    int voterAddress = preVoteReply->getVoterAddress();
+    if (!preVotePhase or !preVoteReply->getVoteGranted() or preVoteReply->getNextTerm() != currentTerm + 1
+            or find(preVoters.begin(), preVoters.end(), voterAddress) != preVoters.end())
+    {
+        return;
+    }
+    preVoters.push_back(voterAddress);
+    if (preVoters.size() > numberVotingMembers / 2)
+    {
+        preVotePhase = false;
+        startNewElection(false);
+    }
+}
+
+// here i received a vote so i increment the current term vote
+void Server::handleVoteReply(cMessage *msg)
+{
+    VoteReply *voteReply = static_cast<VoteReply *>(msg);
+
+    if (voteReply->getCurrentTerm() > currentTerm)
+    {
+        // STEPDOWN PROCEDURE
+        stepdown(voteReply->getCurrentTerm());
+    }
+
+    if (voteReply->getCurrentTerm() == currentTerm && serverState == CANDIDATE)
+    {
+        numberVoteReceived = numberVoteReceived + voteReply->getVoteGranted();
+        if (numberVoteReceived > numberVotingMembers / 2)
+        {
+            // Majority is reached: i am the NEW LEADER
+            bubble("i'm the leader");
+            cDisplayString &dispStr = getDisplayString();
+            dispStr.parse("i=device/server2,gold");
+
+            // if a server becomes leader I have to cancel the timer for a new election since it will
+            // remain leader until the first failure, furthermore i have to reset all state variables, including nextIdex and matchIndex
+            stopTimer(electionTimeoutExpired);
+            if (persistentLog)
+            {
+                // the log counted as the leader's own copy must be durable
+                flushWriteAheadLog();
+            }
+            serverState = LEADER;
+            leaderAddress = networkAddress;
+            numberVoteReceived = 0;
+            catchUpPhaseRunning = false;
+            for (int serverIndex = 0; serverIndex < nextIndex.size(); serverIndex++)
+            {
+                nextIndex[serverIndex] = getLastLogIndex() + 1;
+                inflightAppends[serverIndex].clear();
+                if (serverIndex != networkAddress)
+                {
+                    matchIndex[serverIndex] = -1;
+                }
+                else
+                {
+                    matchIndex[serverIndex] = getLastLogIndex();
+                }
+            }
+
+            if(!leaderTransferPhase)
+            {
+                // add NOP to log
+                log_entry NOP;
+                NOP.clientAddress = NO_CLIENT;
+                NOP.entryTerm = currentTerm;
+                NOP.operandName = 'X';
+                NOP.operandValue = 0;
+                NOP.operation = 'A';
+                NOP.entryLogIndex = getLastLogIndex() + 1;
+                // update next index for leader (appendToLog counts the leader's own copy)
+                nextIndex[getIndex(networkAddress)]++;
+                appendToLog(NOP);
+                // periodical HeartBeat
+
+            }
+            else
+            {
+                log_entry REMOVE;
+                REMOVE.clientAddress = changingServerEntry.clientAddress;
+                REMOVE.entryTerm = currentTerm;
+                REMOVE.entryLogIndex = getLastLogIndex() + 1;
+                REMOVE.addressServerToRemove = changingServerEntry.addressServerToRemove;
+                // update next index for leader (appendToLog counts the leader's own copy)
+                nextIndex[getIndex(networkAddress)]++;
+                appendToLog(REMOVE);
+                int toRemove = REMOVE.addressServerToRemove;
+                configuration.erase(remove(configuration.begin(), configuration.end(), toRemove));
+            }
+            startTimer(heartBeatsReminder, 0);
+            if (checkQuorum)
+            {
+                quorumResponders.clear();
+                startTimer(checkQuorumMsg, minElectionTimeout);
+            }
+        }
+    }
+    leaderTransferPhase = false;
+}
+
+// HEARTBEAT RECEIVED (AppendEntries RPC)
+void Server::handleHeartBeat(cMessage *msg)
+{
+    HeartBeats *heartBeat = static_cast<HeartBeats *>(msg);
+    int lastLogIndex = getLastLogIndex();
+    int term = heartBeat->getLeaderCurrentTerm();
+    int prevLogIndex = heartBeat->getPrevLogIndex();
+    int prevLogTerm = heartBeat->getPrevLogTerm();
+    int leaderCommit = heartBeat->getLeaderCommit();
+    bool condition2Satisfied = true;
+
+    if (serverState == NON_VOTING_MEMBER && heartBeat->getEmpty())
+    {
+        catchUpTargetIndex = heartBeat->getLeaderCommit();
+    }
+
+    /* ****************
+     * LOG IS REFUSED *
+     ******************/
+    // ALL SERVERS: If RPC request or response contains term > currentTerm: set currentTerm = term, convert to follower
+    if (term < currentTerm)
+    {
+        // @ensure LOG MATCHING PROPERTY
+        // CONSISTENCY CHECK: (1) Reply false if term < currentTerm
+        rejectLog(leaderAddress, -1, heartBeat);
+    }
+    else
+    {
+        // CONDITION (1) satisfied
+        currentTerm = term;
+        if (serverState == LEADER)
+        {
+            // a leader of the same or a later term exists: the usual STEPDOWN PROCEDURE
+            stepdown(term);
+        }
+        if(serverState != NON_VOTING_MEMBER)
+        {
+            cDisplayString &dispStr = getDisplayString();
+            dispStr.parse("i=device/server2, bronze");
+            serverState = FOLLOWER;
+        }
+        numberVoteReceived = 0;
+        // alreadyVoted = false;
+        leaderAddress = heartBeat->getLeaderAddress();
+        // (2) Reply false if log doesn't contain an entry at prevLogIndex...
+        // whose term matches prevLogTerm
+        // (2.a) Log is too short
+        if (prevLogIndex > lastLogIndex)
+        {
+            condition2Satisfied = false;
+        }
+        // (2.b) no entry at prevLogIndex whose term matches prevLogTerm
+        if (condition2Satisfied and prevLogIndex >= 0 and prevLogIndex >= lastSnapshot.lastIncludedIndex)
+        {
+            // if logEntries is empty (size == 0) or prevLogTerm == -1 there is no need to deny;
+            // entries already compacted into the snapshot are committed, so they always match
+            if (getLogTerm(prevLogIndex) != prevLogTerm)
+            {
+                condition2Satisfied = false;
+            }
+
+        }
+        if (condition2Satisfied)
+        {
+            /*******************
+             * LOG IS ACCEPTED *
+             *******************/
+            leaderAddress = heartBeat->getLeaderAddress();
+            // CASE A: heartbeat DOES NOT CONTAIN ANY ENTRY, the follower
+            //         replies to confirm consistency with leader's log
+            if (heartBeat->getEmpty())
+            {
+                if (leaderCommit > commitIndex)
+                {
+                    commitIndex = min(leaderCommit, prevLogIndex); // no new entries in the message: we can guarantee consistency up to prevLogIndex
+                    scheduleApply();
+                }
+                acceptLog(leaderAddress, prevLogIndex, heartBeat);
+            }
+            else
+            {
+                // CASE B: heartbeat delivers a run of new entries for follower's log,
+                //         starting right after prevLogIndex
+                // @ensure CONSISTENCY WITH SEVER LOG UP TO prevLogIndex
+                int numEntries = heartBeat->getEntriesArraySize();
+                for (int i = 0; i < numEntries; i++)
+                {
+                    appendEntryFromLeader(heartBeat->getEntries(i));
+                }
+                int lastNewEntryIndex = prevLogIndex + numEntries;
+
+                if(serverState == NON_VOTING_MEMBER && heartBeat->getLeaderCommit() == catchUpTargetIndex)
+                {
+                    // become follower
+                    stepdown(heartBeat->getLeaderCurrentTerm());
+                }
+                /* NOTE: the whole run is acknowledged with a single response.
+                 * @ensure (5) If leaderCommit > commitIndex, set commitIndex = min(leaderCommit, index of last new entry)
+                 * index of last */
+                acceptLog(leaderAddress, lastNewEntryIndex, heartBeat);
+                if (leaderCommit > commitIndex)
+                {
+                    commitIndex = min(leaderCommit, lastNewEntryIndex);
+                    scheduleApply();
+                }
+            }
+        }
+        else
+        {
+            rejectLog(leaderAddress, prevLogIndex, heartBeat);
+            restartCountdown();
+        }
+    }
+    startAcceptVoteRequestCountdown();
+    restartCountdown();
+}
+
+// SNAPSHOT RECEIVED (InstallSnapshot RPC)
+void Server::handleInstallSnapshot(cMessage *msg)
+{
+    InstallSnapshot *installSnapshot = static_cast<InstallSnapshot *>(msg);
+    int term = installSnapshot->getLeaderCurrentTerm();
+    if (term < currentTerm)
+    {
+        // answer the sender, which may not be the leader this server knows
+        rejectLog(installSnapshot->getLeaderAddress(), -1);
+    }
+    else
+    {
+        currentTerm = term;
+        if (serverState == LEADER)
+        {
+            // a leader of the same or a later term exists: the usual STEPDOWN PROCEDURE
+            stepdown(term);
+        }
+        if(serverState != NON_VOTING_MEMBER)
+        {
+            cDisplayString &dispStr = getDisplayString();
+            dispStr.parse("i=device/server2, bronze");
+            serverState = FOLLOWER;
+        }
+        numberVoteReceived = 0;
+        leaderAddress = installSnapshot->getLeaderAddress();
+        restoreSnapshot(installSnapshot->getSnapshotData());
+        // the follower's log is now consistent with the leader's up to the snapshot boundary
+        acceptLog(leaderAddress, installSnapshot->getSnapshotData().lastIncludedIndex);
+    }
+    startAcceptVoteRequestCountdown();
+    restartCountdown();
+}
+
+// RECEIVED RESPONSE FROM A FOLLOWER
+void Server::handleHeartBeatResponse(cMessage *msg)
+{
+    HeartBeatResponse *heartBeatResponse = static_cast<HeartBeatResponse *>(msg);
+    int followerAddr = heartBeatResponse->getFollowerAddress();
+    int followerIndex = getIndex(followerAddr);
+    int followerLogLength = heartBeatResponse->getLogLength();
+    int followerMatchIndex = heartBeatResponse->getMatchIndex();
+    // CHECK QUORUM: any response of the current term shows that the follower can reach the leader
+    if (serverState == LEADER && checkQuorum && heartBeatResponse->getTerm() == currentTerm
+            && find(quorumResponders.begin(), quorumResponders.end(), followerAddr) == quorumResponders.end())
+    {
+        quorumResponders.push_back(followerAddr);
+    }
+    // LEASE: a response of the current term proves that the follower will not vote for
+    // another candidate for minElectionTimeout since the heartbeat was sent
+    if (serverState == LEADER && leaseReads && heartBeatResponse->getTerm() == currentTerm
+            && heartBeatResponse->getHeartBeatSentAt() >= 0)
+    {
+        if (followerIndex >= leaseAckSentAt.size())
+        {
+            leaseAckSentAt.resize(followerIndex + 1, -1);
+        }
+        if (heartBeatResponse->getHeartBeatSentAt() > leaseAckSentAt[followerIndex])
+        {
+            leaseAckSentAt[followerIndex] = SIMTIME_DBL(heartBeatResponse->getHeartBeatSentAt());
+        }
+    }
+    // READ INDEX: any response of the current term to the pending round confirms the leadership
+    if (serverState == LEADER && readRoundInFlight > 0 && heartBeatResponse->getReadRound() == readRoundInFlight
+            && heartBeatResponse->getTerm() == currentTerm)
+    {
+        acknowledgeReadRound(followerAddr);
+    }
+    if (heartBeatResponse->getSucceded() && pipelineAppends)
+    {
+        // heartBeat accepted: responses may refer to older appends, so never move backwards
+        if (followerMatchIndex > matchIndex[followerIndex])
+        {
+            matchIndex[followerIndex] = followerMatchIndex;
+        }
+        if (nextIndex[followerIndex] <= matchIndex[followerIndex])
+        {
+            nextIndex[followerIndex] = matchIndex[followerIndex] + 1;
+        }
+        // release the acknowledged appends from the in-flight window
+        while (!inflightAppends[followerIndex].empty() && inflightAppends[followerIndex].front().lastIndex <= followerMatchIndex)
+        {
+            inflightAppends[followerIndex].erase(inflightAppends[followerIndex].begin());
+        }
+        // a slot is free again: keep the pipe full
+        if (serverState == LEADER && nextIndex[followerIndex] <= getLastLogIndex()
+                && inflightAppends[followerIndex].size() < maxInflightAppends)
+        {
+            sendAppendEntries(followerAddr);
+        }
+
+        // catch up phase round ends
+        if (catchUpPhaseRunning && followerAddr == changingServerEntry.addressServerToAdd && matchIndex[followerIndex] == catchUpTargetIndex)
+        {
+            endCatchUpRound();
+        }
+    }
+    else if (heartBeatResponse->getSucceded())
+    {
+        // heartBeat accepted
+        matchIndex[followerIndex] = followerMatchIndex;
+        nextIndex[followerIndex] = matchIndex[followerIndex] + 1;
+
+        // catch up phase round ends
+        if (catchUpPhaseRunning && followerAddr == changingServerEntry.addressServerToAdd && matchIndex[followerIndex] == catchUpTargetIndex)
+        {
+            endCatchUpRound();
+        }
+    }
+    else
+    {
+        // the in-flight appends following a rejected one are useless
+        inflightAppends[followerIndex].clear();
+        if (heartBeatResponse->getTerm() > currentTerm)
+        {
+            stopTimer(heartBeatsReminder);
+            stopTimer(electionTimeoutExpired);
+            currentTerm = heartBeatResponse->getTerm();
+            startNewElection(false);
+        }
+        else if (heartBeatResponse->getConflictIndex() >= 0)
+        {
+            // heartBeat rejected: skip the whole conflicting term at once
+            // the hint is used as is (duplicate or pipelined rejections give the same answer), kept between
+            // the last entry known to be replicated and the end of the leader's log
+            int conflictNextIndex = nextIndexAfterConflict(heartBeatResponse->getConflictTerm(), heartBeatResponse->getConflictIndex());
+            if (conflictNextIndex <= matchIndex[followerIndex])
+            {
+                conflictNextIndex = matchIndex[followerIndex] + 1;
+            }
+            if (conflictNextIndex > getLastLogIndex() + 1)
+            {
+                conflictNextIndex = getLastLogIndex() + 1;
+            }
+            nextIndex[followerIndex] = conflictNextIndex;
+        }
+        else if (pipelineAppends && matchIndex[followerIndex] >= 0)
+        {
+            // heartBeat rejected: roll back to the last entry known to be replicated
+            nextIndex[followerIndex] = matchIndex[followerIndex] + 1;
+        }
+        else if (followerLogLength < nextIndex[followerIndex])
+        {
+            // heartBeat rejected
+            nextIndex[followerIndex] = followerLogLength;
+        }
+        else
+        {
+            if (nextIndex[followerIndex] > 0)
+            {
+                nextIndex[followerIndex] = nextIndex[followerIndex] - 1;
+            }
+        }
+    }
+    updateCommitIndexOnLeader();
+    startAcceptVoteRequestCountdown();
+}
+
+// LOG MESSAGE REQUEST RECEIVED, it is ignored only if leader transfer process is going on.
+// Read-only requests are served from the state machine without touching the log (ReadIndex)
+void Server::handleLogMessage(cMessage *msg)
+{
+    LogMessage *logMessage = static_cast<LogMessage *>(msg);
+    if (leaderTransferPhase)
+    {
+        return;
+    }
+    if (leaderAddress < 0)
+    {
+        // no leader known (e.g. after a CheckQuorum stepdown): the client backs off and tries again
+        sendResponseToClient(logMessage->getClientAddress(), logMessage->getSerialNumber(), false, true);
+        return;
+    }
+    if (logMessage->getReadOnly() && readIndexReads)
+    {
+        handleReadOnlyRequest(logMessage);
+        return;
+    }
+    int serialNumber = logMessage->getSerialNumber();
+    int clientAddress = logMessage->getClientAddress();
+    bool alreadyReceived = false;
+    last_req* lastReqHashEntry = getLastRequest(clientAddress);
+
+    if (lastReqHashEntry != nullptr)
+    {
+        // verify whether the entry was already received or not (the client may have several requests in flight)
+        alreadyReceived = serialSeen(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, serialNumber);
+        if (alreadyReceived and networkAddress == leaderAddress
+                and !serialSeen(lastReqHashEntry->lastAppliedSerial, lastReqHashEntry->appliedWindow, serialNumber)
+                and lastReqHashEntry->lastLoggedIndex <= lastApplied
+                and !isProposalPending(clientAddress, serialNumber))
+        {
+            // every entry of the client in the log has been applied, but not this one: it was lost
+            // with a previous leader, accept it again
+            alreadyReceived = false;
+        }
+    }
+    else
+    {
+        // first message from the client: add an entry to the table
+        lastReqHashEntry = addNewRequestEntry(clientAddress);
+    }
+    markSerialSeen(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, serialNumber);
+
+    if (alreadyReceived)
+    {
+        // message already received
+        if (serialSeen(lastReqHashEntry->lastAppliedSerial, lastReqHashEntry->appliedWindow, serialNumber))
+        {
+            // ACK: request has already been committed
+            bubble("This request has already been committed!");
+            if (stateMachine->isReadOnly(logMessage->getOperation()) and networkAddress == leaderAddress)
+            {
+                // the result of a read is not kept: execute it again
+                log_entry readEntry;
+                strncpy(readEntry.key, logMessage->getKey(), KV_KEY_SIZE - 1);
+                state_machine_result result;
+                stateMachine->read(readEntry, result);
+                sendResultToClient(clientAddress, serialNumber, result);
+            }
+            else
+            {
+                sendResponseToClient(clientAddress, serialNumber, true, false);
+            }
+        }
+        else if (networkAddress != leaderAddress)
+        {
+            // Redirect to leader in case the message is received by a follower.
+            sendResponseToClient(clientAddress, serialNumber, false, true);
+        }
+        else
+        {
+            // NACK: request yet to commit
+            bubble("This request is already in the log, but it is still uncommitted");
+            sendResponseToClient(clientAddress, serialNumber, false, false);
+        }
+    }
+    else
+    {
+        // new message
+        if (networkAddress != leaderAddress)
+        {
+            // Redirect to leader in case the message is received by a follower.
+            sendResponseToClient(clientAddress, serialNumber, false, true);
+        }
+        else
+        {
+            // once a log message is received a new log entry is added in the leader node
+            log_entry newEntry;
+            newEntry.clientAddress = logMessage->getClientAddress();
+            newEntry.entryTerm = currentTerm;
+            newEntry.operandName = logMessage->getOperandName();
+            newEntry.operandValue = logMessage->getOperandValue();
+            newEntry.operation = logMessage->getOperation();
+            strncpy(newEntry.key, logMessage->getKey(), KV_KEY_SIZE - 1);
+            newEntry.valueLength = std::min<size_t>(strlen(logMessage->getValue()), KV_VALUE_SIZE);
+            memcpy(newEntry.value, logMessage->getValue(), newEntry.valueLength);
+            newEntry.serialNumber = logMessage->getSerialNumber();
+            newEntry.addressServerToAdd = logMessage->getServerToAdd();
+            newEntry.addressServerToRemove = logMessage->getServerToRemove();
+            newEntry.entryLogIndex = getLastLogIndex() + 1;
+            if (logMessage->getServerToRemove() < 0 and logMessage->getServerToAdd() < 0)
+            {
+                // ordinary entry
+                proposeEntry(newEntry);
+            }
+            else if (commitIndex >= 0  and getLogTerm(commitIndex) == currentTerm)
+            {
+                // change configuration entry
+                // but only accept the request if some entry has been committed in the current term
+                // (the requests received before it go first in the log)
+                flushProposals();
+                newEntry.entryLogIndex = getLastLogIndex() + 1;
+                startMembershipChangeProcedure(newEntry);
+            }
+            else
+            {
+                forgetSerial(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, serialNumber);
+            }
+        }
+    }
+}
+
+// READ-ONLY REQUEST RECEIVED: served from the state machine without touching the log (ReadIndex)
+void Server::handleReadOnlyRequest(LogMessage *logMessage)
+{
+    int serialNumber = logMessage->getSerialNumber();
+    int clientAddress = logMessage->getClientAddress();
+    if (networkAddress != leaderAddress and followerReads and serverState == FOLLOWER)
+    {
+        // FOLLOWER READ: the read index is asked to the leader, together with the other pending reads
+        pending_read read;
+        read.clientAddress = clientAddress;
+        read.serialNumber = serialNumber;
+        read.readIndex = -1;   // known when the leader answers
+        read.readRound = readRoundCounter + 1;
+        read.command.operandName = logMessage->getOperandName();
+        read.command.operation = logMessage->getOperation();
+        strncpy(read.command.key, logMessage->getKey(), KV_KEY_SIZE - 1);
+        pendingReads.push_back(read);
+        if (readRoundInFlight == 0)
+        {
+            sendReadIndexRequest();
+        }
+    }
+    else if (networkAddress != leaderAddress)
+    {
+        // Redirect to leader in case the message is received by a follower.
+        sendResponseToClient(clientAddress, serialNumber, false, true);
+    }
+    else if (commitIndex < 0 or getLogTerm(commitIndex) != currentTerm)
+    {
+        // the commitIndex of a new leader is reliable only after an entry of its term is committed
+        sendResponseToClient(clientAddress, serialNumber, false, false);
+    }
+    else
+    {
+        pending_read read;
+        read.clientAddress = clientAddress;
+        read.serialNumber = serialNumber;
+        read.readIndex = commitIndex;
+        // reads arriving while a round is in flight wait for the next one
+        read.readRound = readRoundCounter + 1;
+        read.command.operandName = logMessage->getOperandName();
+        read.command.operation = logMessage->getOperation();
+        strncpy(read.command.key, logMessage->getKey(), KV_KEY_SIZE - 1);
+        if (leaseReads && hasValidLease())
+        {
+            // LEASE: leadership is already guaranteed, no round needed
+            read.readRound = lastConfirmedReadRound;
+            if (read.readIndex <= lastApplied)
+            {
+                state_machine_result result;
+                stateMachine->read(read.command, result);
+                sendResultToClient(clientAddress, serialNumber, result);
+                leaseReadsServed++;
+            }
+            else
+            {
+                pendingReads.push_back(read);
+            }
+        }
+        else
+        {
+            pendingReads.push_back(read);
+            if (readRoundInFlight == 0)
+            {
+                startReadRound();
+            }
+        }
+    }
+}
+
+// READ INDEX ASKED BY A FOLLOWER: answered as soon as the leadership is confirmed
+void Server::handleReadIndexRequest(cMessage *msg)
+{
+    ReadIndexRequest *readIndexQuery = static_cast<ReadIndexRequest *>(msg);
+    int followerAddr = readIndexQuery->getFollowerAddress();
+    int requestId = readIndexQuery->getRequestId();
+    if (serverState != LEADER or leaderTransferPhase or commitIndex < 0 or getLogTerm(commitIndex) != currentTerm)
+    {
+        sendReadIndexResponse(followerAddr, requestId, -1, false);
+    }
+    else if (leaseReads && hasValidLease())
+    {
+        sendReadIndexResponse(followerAddr, requestId, commitIndex, true);
+    }
+    else
+    {
+        pending_read read;
+        read.clientAddress = followerAddr;
+        read.serialNumber = requestId;
+        read.readIndex = commitIndex;
+        read.readRound = readRoundCounter + 1;
+        read.forFollower = true;
+        pendingReads.push_back(read);
+        if (readRoundInFlight == 0)
+        {
+            startReadRound();
+        }
+    }
+}
+
+// READ INDEX RECEIVED FROM THE LEADER: the batch it covers waits for lastApplied to reach it
+void Server::handleReadIndexResponse(cMessage *msg)
+{
+    ReadIndexResponse *readIndexReply = static_cast<ReadIndexResponse *>(msg);
+    if (readIndexReply->getRequestId() != readRoundInFlight or serverState == LEADER)
+    {
+        return;
+    }
+    stopTimer(readIndexTimeout);
+    if (readIndexReply->getSucceded())
+    {
+        int requestId = readIndexReply->getRequestId();
+        for (int i = 0; i < pendingReads.size(); i++)
+        {
+            if (pendingReads[i].readRound <= requestId && pendingReads[i].readIndex < 0)
+            {
+                pendingReads[i].readIndex = readIndexReply->getReadIndex();
+            }
+        }
+        lastConfirmedReadRound = requestId;
+        readRoundInFlight = 0;
+        serveConfirmedReads();
+        // the reads arrived in the meantime need a new request
+        if (!pendingReads.empty() && pendingReads.back().readRound > lastConfirmedReadRound)
+        {
+            sendReadIndexRequest();
+        }
+    }
+    else
+    {
+        failPendingReads();
+    }
+}
+
+// FORCED TIMEOUT MESSAGE DUE TO LEADER TRANSFER
+void Server::handleTimeOutNow(cMessage *msg)
+{
+    TimeOutNow *timeOutnow = static_cast<TimeOutNow *>(msg);
+    leaderTransferPhase = true;
+    log_entry rm_serv ;
+    rm_serv.addressServerToRemove = timeOutnow->getServerToRemove();
+    rm_serv.clientAddress = timeOutnow->getClientAddress();
+    rm_serv.serialNumber = timeOutnow->getSerialNumber();
+    changingServerEntry = rm_serv;
+    stopTimer(electionTimeoutExpired);
+    startNewElection(true);
+}
+
+// Sends an AppendEntries RPC to the follower, carrying the entries from nextIndex on (if any)
+void Server::sendAppendEntries(int followerAddr)
+{
+    int followerIndex = getIndex(followerAddr);
+    int lastLogIndex = getLastLogIndex();
+    int nextLogIndex = nextIndex[followerIndex];
+    if (nextLogIndex < logEntries.getStartIndex())
+    {
+        // the entries the follower needs have been compacted: send the snapshot instead
+        sendSnapshot(followerAddr);
+        return;
+    }
+    HeartBeats *RPCAppendEntriesMsg = new HeartBeats("i'm the leader");
+    RPCAppendEntriesMsg->setLeaderAddress(networkAddress);
+    RPCAppendEntriesMsg->setDestAddress(followerAddr);
+    RPCAppendEntriesMsg->setLeaderCurrentTerm(currentTerm);
+    RPCAppendEntriesMsg->setLeaderCommit(commitIndex);
+    RPCAppendEntriesMsg->setPrevLogIndex(nextLogIndex - 1);
+    RPCAppendEntriesMsg->setReadRound(readRoundInFlight);
+    RPCAppendEntriesMsg->setSentAt(simTime());
+    // leader's log not empty
+    if (nextLogIndex == 0 )
+    {
+        RPCAppendEntriesMsg->setPrevLogTerm(1);
+    }
+    else
+    {
+        RPCAppendEntriesMsg->setPrevLogTerm(getLogTerm(nextLogIndex - 1));
+    }
+
+    // with pipelining enabled, a full in-flight window degrades the append to a plain heartbeat
+    bool windowFull = pipelineAppends && inflightAppends[followerIndex].size() >= maxInflightAppends;
+    if (nextLogIndex <= lastLogIndex && !windowFull)
+    {
+        // follower's log needs an update: ship a run of entries starting at nextLogIndex,
+        // bounded by maxEntriesPerAppend and maxAppendBytes (at least one entry is always sent)
+        int numEntries = 0;
+        int appendBytes = 0;
+        while (nextLogIndex + numEntries <= lastLogIndex && numEntries < maxEntriesPerAppend
+                && (numEntries == 0 || appendBytes + (int) sizeof(log_entry) <= maxAppendBytes))
+        {
+            appendBytes = appendBytes + sizeof(log_entry);
+            numEntries++;
+        }
+        if (logSegments.isOpen())
+        {
+            // read the run straight from the mapped segment (it may end earlier, at the segment boundary)
+            const log_entry *run = logSegments.slice(nextLogIndex, numEntries);
+            RPCAppendEntriesMsg->setEntriesArraySize(numEntries);
+            for (int i = 0; i < numEntries; i++)
+            {
+                RPCAppendEntriesMsg->setEntries(i, run[i]);
+            }
+        }
+        else
+        {
+            RPCAppendEntriesMsg->setEntriesArraySize(numEntries);
+            for (int i = 0; i < numEntries; i++)
+            {
+                RPCAppendEntriesMsg->setEntries(i, getLogEntry(nextLogIndex + i));
+            }
+        }
+        RPCAppendEntriesMsg->setEmpty(false);
+
+        if (pipelineAppends)
+        {
+            // optimistic: assume the run will be accepted and move nextIndex past it
+            inflight_append append;
+            append.firstIndex = nextLogIndex;
+            append.lastIndex = nextLogIndex + numEntries - 1;
+            append.sendTime = simTime();
+            inflightAppends[followerIndex].push_back(append);
+            nextIndex[followerIndex] = append.lastIndex + 1;
+        }
+    }
+    // remember when the follower was contacted, the periodic heartbeat may be skipped
+    if (followerIndex >= appendSentAt.size())
+    {
+        appendSentAt.resize(followerIndex + 1, -1);
+        commitIndexSent.resize(followerIndex + 1, -1);
+    }
+    appendSentAt[followerIndex] = SIMTIME_DBL(simTime());
+    commitIndexSent[followerIndex] = commitIndex;
+    if(gate("gateServer$o", 0)->isConnected())
+        send(RPCAppendEntriesMsg, "gateServer$o", 0);
+}
+
+// Heartbeat suppression: the periodic heartbeat is only needed when the follower has not been contacted
+// within the last period, has entries to receive, or does not know the current commit index yet
+bool Server::heartbeatNeeded(int followerAddr)
+{
+    int followerIndex = getIndex(followerAddr);
+    if (!suppressHeartbeats || followerIndex >= appendSentAt.size() || appendSentAt[followerIndex] < 0)
+    {
+        return true;
+    }
+    if (nextIndex[followerIndex] <= getLastLogIndex() || commitIndexSent[followerIndex] != commitIndex)
+    {
+        return true;
+    }
+    return simTime() - appendSentAt[followerIndex] >= heartbeatsPeriod;
+}
+
+// Eager replication: new entries are shipped after a short coalescing delay, so that bursts travel together
+void Server::scheduleReplication()
+{
+    if (eagerReplication && serverState == LEADER && !replicateEntriesMsg->isScheduled())
+    {
+        startTimer(replicateEntriesMsg, replicationDelay);
+    }
+}
+
+// A new client request accepted by the leader. With proposal batching the requests are collected
+// and appended as a contiguous run, so that they are replicated and acknowledged together
+void Server::proposeEntry(log_entry entry)
+{
+    pendingProposals.push_back(entry);
+    if (maxProposalBatch <= 1 || pendingProposals.size() >= maxProposalBatch)
+    {
+        flushProposals();
+    }
+    else if (!proposalBatchMsg->isScheduled())
+    {
+        startTimer(proposalBatchMsg, proposalBatchDelay);
+    }
+}
+
+void Server::flushProposals()
+{
+    stopTimer(proposalBatchMsg);
+    if (pendingProposals.empty())
+        return;
+    if (serverState != LEADER)
+    {
+        dropProposals();
+        return;
+    }
+    for (int i = 0; i < pendingProposals.size(); i++)
+    {
+        log_entry &newEntry = pendingProposals[i];
+        newEntry.entryTerm = currentTerm;
+        newEntry.entryLogIndex = getLastLogIndex() + 1;
+        // update next index for leader (appendToLog counts the leader's own copy)
+        nextIndex[getIndex(networkAddress)]++;
+        appendToLog(newEntry);
+        // update last received index
+        last_req* lastReqHashEntry = getLastRequest(newEntry.clientAddress);
+        if (lastReqHashEntry == nullptr)
+        {
+            lastReqHashEntry = addNewRequestEntry(newEntry.clientAddress);
+        }
+        lastReqHashEntry->lastLoggedIndex = newEntry.entryLogIndex;
+    }
+    proposalBatches++;
+    batchedProposals += pendingProposals.size();
+    pendingProposals.clear();
+    scheduleReplication();
+}
+
+// The leader lost its role (or crashed) before appending the requests: the clients will send them again
+void Server::dropProposals()
+{
+    stopTimer(proposalBatchMsg);
+    for (int i = 0; i < pendingProposals.size(); i++)
+    {
+        last_req* lastReqHashEntry = getLastRequest(pendingProposals[i].clientAddress);
+        if (lastReqHashEntry != nullptr)
+            forgetSerial(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, pendingProposals[i].serialNumber);
+    }
+    pendingProposals.clear();
+}
+
+bool Server::isProposalPending(int clientAddress, int serialNumber)
+{
+    for (int i = 0; i < pendingProposals.size(); i++)
+    {
+        if (pendingProposals[i].clientAddress == clientAddress && pendingProposals[i].serialNumber == serialNumber)
+            return true;
+    }
+    return false;
+}
+
+// Every change to the log goes through these two functions so that it is also recorded in the write-ahead log
+void Server::appendToLog(log_entry entry)
+{
+    if (serverState == LEADER)
+    {
+        // log time: the leader stamps the entries it creates, followers keep the leader's stamp
+        entry.entryTime = SIMTIME_DBL(simTime());
+    }
+    logEntries.append(entry);
+    if (persistentLog)
+    {
+        wal.appendEntry(entry);
+        logSegments.append(entry);
+        // the leader's own copy counts toward the quorum only once it is flushed (flushWriteAheadLog)
+        scheduleWalFlush();
+    }
+    else if (serverState == LEADER)
+    {
+        matchIndex[getIndex(networkAddress)] = getLastLogIndex();
+    }
+}
+
+void Server::truncateLog(int fromIndex)
+{
+    logEntries.truncateFrom(fromIndex);
+    if (persistentLog)
+    {
+        wal.appendTruncate(fromIndex);
+        logSegments.truncateFrom(fromIndex);
+        scheduleWalFlush();
+    }
+}
+
+// Sends a message that promises something about the persistent state (term, vote, log entries):
+// with the write-ahead log enabled it waits for the next group commit
+void Server::sendDurably(cMessage *msg)
+{
+    if (persistentLog)
+    {
+        persistTermAndVote();
+        if (wal.hasPendingWrites())
+        {
+            pendingDurableMsgs.push_back(msg);
+            return;
+        }
+    }
+    if(gate("gateServer$o", 0)->isConnected())
+        send(msg, "gateServer$o", 0);
+}
+
+// Records the term and the vote (if they changed) and arms the group commit
+void Server::persistTermAndVote()
+{
+    wal.persistTermAndVote(currentTerm, lastVotedTerm);
+    scheduleWalFlush();
+}
+
+void Server::scheduleWalFlush()
+{
+    if (wal.hasPendingWrites() && !walFlushMsg->isScheduled())
+    {
+        startTimer(walFlushMsg, walGroupCommitDelay);
+    }
+}
+
+void Server::flushWriteAheadLog()
+{
+    wal.flush();
+    for (int i = 0; i < pendingDurableMsgs.size(); i++)
+    {
+        if(gate("gateServer$o", 0)->isConnected())
+            send(pendingDurableMsgs[i], "gateServer$o", 0);
+    }
+    pendingDurableMsgs.clear();
+    if (serverState == LEADER)
+    {
+        // the whole log is durable now: the leader's own copy counts toward the quorum
+        matchIndex[getIndex(networkAddress)] = getLastLogIndex();
+        updateCommitIndexOnLeader();
+    }
+}
+
+// After a crash only what was flushed to the write-ahead log survives: the volatile state
+// restarts from the snapshot and the committed entries will be applied again
+void Server::recoverFromWriteAheadLog()
+{
+    wal_recovered_state state;
+    if (!wal.recover(state))
+    {
+        return;
+    }
+    currentTerm = state.currentTerm;
+    lastVotedTerm = state.lastVotedTerm;
+    if (state.hasSnapshot)
+    {
+        lastSnapshot = state.snapshot;
+        stateMachine->restoreSnapshot(lastSnapshot.stateMachineData);
+        configuration = lastSnapshot.configuration;
+        requestTable = lastSnapshot.requestTable;
+        lastAppliedEntryTime = lastSnapshot.lastAppliedEntryTime;
+    }
+    else
+    {
+        lastSnapshot = state_snapshot();
+        stateMachine->reset();
+        requestTable.clear();
+        lastAppliedEntryTime = 0;
+    }
+    commitIndex = lastSnapshot.lastIncludedIndex;
+    lastApplied = lastSnapshot.lastIncludedIndex;
+    logEntries.reset(lastSnapshot.lastIncludedIndex + 1);
+    logSegments.reset(lastSnapshot.lastIncludedIndex + 1);
+    for (int i = 0; i < state.entries.size(); i++)
+    {
+        log_entry entry = state.entries[i];
+        logEntries.append(entry);
+        logSegments.append(entry);
+        if (entry.clientAddress != NO_CLIENT)
+        {
+            last_req* lastRequestFromClient = getLastRequest(entry.clientAddress);
+            if(lastRequestFromClient == nullptr)
+            {
+                lastRequestFromClient = addNewRequestEntry(entry.clientAddress);
+            }
+            lastRequestFromClient->lastLoggedIndex = entry.entryLogIndex;
+            markSerialSeen(lastRequestFromClient->lastArrivedSerial, lastRequestFromClient->arrivedWindow, entry.serialNumber);
+        }
+    }
+    EV << "Server[" + to_string(getIndex(networkAddress)) + "] recovered " + to_string(state.entries.size()) + " entries from the write-ahead log\n";
+}
+
+void Server::acceptLog(int leaderAddress, int matchIndex, HeartBeats *heartBeat)
+{
+    HeartBeatResponse *reply = new HeartBeatResponse("Consistency check: OK");
+    echoHeartBeat(reply, heartBeat);
+    reply->setMatchIndex(matchIndex);
+    reply->setTerm(currentTerm);
+    reply->setSucceded(true);
+    reply->setLeaderAddress(leaderAddress);
+    reply->setFollowerAddress(networkAddress);
+    sendDurably(reply);
+}
+
+// The response tells the leader which heartbeat it answers: read round and sending time (lease)
+void Server::echoHeartBeat(HeartBeatResponse *reply, HeartBeats *heartBeat)
+{
+    if (heartBeat != nullptr)
+    {
+        reply->setReadRound(heartBeat->getReadRound());
+        reply->setHeartBeatSentAt(heartBeat->getSentAt());
+    }
+}
+
+// Appends a single entry received from the leader, truncating the log on conflict
+void Server::appendEntryFromLeader(log_entry entry)
+{
+    int lastLogIndex = getLastLogIndex();
+    int newEntryIndex = entry.entryLogIndex;
+    last_req* lastRequestFromClient;
+
+    // Entry already compacted into the snapshot: it is committed, so it cannot conflict
+    if (newEntryIndex <= lastSnapshot.lastIncludedIndex)
+    {
+        return;
+    }
+    // No entry at newEntryIndex, simply append the new entry
+    else if (lastLogIndex < newEntryIndex)
+    {
+        appendToLog(entry);
+    }
+    // @ensure (3): if an existing entry conflicts with a new one (same index but different terms),
+    //              delete the existing entry and all that follow it
+    // Conflicting entry at newEntryIndex, delete the last entries up to newEntryIndex, then append the new entry
+    else if (getLogTerm(newEntryIndex) != entry.entryTerm)
+    {
+        truncateLog(newEntryIndex);
+        appendToLog(entry);
+    }
+    else
+    {
+        // NOTE: if a replica receives the same entry twice, it simply ignores the second one
+        return;
+    }
+
+    // client request index = index of last the entry. Ignore NOPs
+    if (entry.clientAddress != NO_CLIENT)
+    {
+        lastRequestFromClient = getLastRequest(entry.clientAddress);
+        if(lastRequestFromClient == nullptr)
+        {
+            lastRequestFromClient = addNewRequestEntry(entry.clientAddress);
+        }
+        lastRequestFromClient->lastLoggedIndex = getLastLogIndex();
+    }
+    // CONFIGURATION CHANGE
+    // ADD SERVER
+    int toAdd = entry.addressServerToAdd;
+    if(toAdd >= 0 && find(configuration.begin(), configuration.end(), toAdd) == configuration.end())
+    {
+        configuration.push_back(toAdd);
+        // if a new server arrives for the first time, then extend nextIndex and matchIndex
+        if(not(entry.operandValue < nextIndex.size()))
+        {
+            nextIndex.push_back(0);
+            matchIndex.push_back(-1);
+            inflightAppends.push_back(vector<inflight_append>());
+        }
+    }
+    // REMOVE SERVER
+    else if (entry.addressServerToRemove >= 0)
+    {
+        int toRemove = entry.addressServerToRemove;
+        configuration.erase(remove(configuration.begin(), configuration.end(), toRemove), configuration.end());
+    }
 }
 
-void Server::rejectLog(int leaderAddress)
+// prevLogIndex is the index of the failed consistency check (-1 if the log was refused because of the term):
+// it is used to give the leader a hint about where the logs diverge
+void Server::rejectLog(int leaderAddress, int prevLogIndex, HeartBeats *heartBeat)
 {
     HeartBeatResponse *reply = new HeartBeatResponse("Consistency check: FAIL");
+    echoHeartBeat(reply, heartBeat);
     reply->setMatchIndex(-1);
     reply->setTerm(currentTerm);
     reply->setSucceded(false);
     reply->setLeaderAddress(leaderAddress);
-    reply->setLogLength(logEntries.size());
+    reply->setLogLength(getLastLogIndex() + 1);
+    if (prevLogIndex > getLastLogIndex())
+    {
+        // log is too short: no conflicting term, the leader can resume from the end of this log
+        reply->setConflictTerm(-1);
+        reply->setConflictIndex(getLastLogIndex() + 1);
+    }
+    else if (prevLogIndex >= 0)
+    {
+        // conflicting entry at prevLogIndex: report its term and the first index of that term
+        int conflictTerm = getLogTerm(prevLogIndex);
+        int conflictIndex = prevLogIndex;
+        while (conflictIndex > logEntries.getStartIndex() && getLogTerm(conflictIndex - 1) == conflictTerm)
+        {
+            conflictIndex--;
+        }
+        reply->setConflictTerm(conflictTerm);
+        reply->setConflictIndex(conflictIndex);
+    }
     reply->setFollowerAddress(networkAddress);
-    if(gate("gateServer$o", 0)->isConnected())
-        send(reply, "gateServer$o", 0);
+    sendDurably(reply);
+}
+
+// Fast log backtracking: if the leader has entries of the conflicting term, the follower can be resumed
+// right after the last of them, otherwise the whole term is skipped and the follower resumes from conflictIndex
+int Server::nextIndexAfterConflict(int conflictTerm, int conflictIndex)
+{
+    if (conflictTerm >= 0)
+    {
+        // terms in the log never decrease, so the scan stops as soon as an older term is found
+        for (int index = getLastLogIndex(); index >= logEntries.getStartIndex() && getLogTerm(index) >= conflictTerm; index--)
+        {
+            if (getLogTerm(index) == conflictTerm)
+            {
+                return index + 1;
+            }
+        }
+    }
+    return conflictIndex;
 }
 
 void Server::tryLeaderTransfer(int addr)
@@ -838,9 +1693,10 @@ void Server::tryLeaderTransfer(int addr)
     if(gate("gateServer$o", 0)->isConnected())
         send(timeOutNow, "gateServer$o", 0);
     timeOutNowSent = true;
+    // the target will start an election that ignores the vote countdown: the lease is not safe anymore
+    invalidateLease();
 
-    leaderTransferFailed = new cMessage("Leader transfer failed");
-    scheduleAt(simTime() + maxElectionTimeout, leaderTransferFailed);
+    startTimer(leaderTransferFailed, maxElectionTimeout);
 }
 
 void Server::sendResponseToClient(int clientAddress, int serialNumber, bool succeded, bool redirect)
@@ -867,22 +1723,34 @@ void Server::sendResponseToClient(int clientAddress, int serialNumber, bool succ
         send(resp, "gateServer$o", 0);
 }
 
+// ACK carrying the result of a read
+void Server::sendResultToClient(int clientAddress, int serialNumber, const state_machine_result &result)
+{
+    LogMessageResponse *resp = new LogMessageResponse("ACK");
+    resp->setClientAddress(clientAddress);
+    resp->setLogSerialNumber(serialNumber);
+    resp->setLeaderAddress(leaderAddress);
+    resp->setSucceded(true);
+    resp->setRedirect(false);
+    resp->setFound(result.found);
+    resp->setValue(result.value.c_str());
+    if(gate("gateServer$o", 0)->isConnected())
+        send(resp, "gateServer$o", 0);
+}
+
 void Server::restartCountdown()
 {
-    cancelEvent(electionTimeoutExpired);
-    electionTimeoutExpired = new cMessage("NewElectionTimeoutExpired");
-    double randomTimeout = uniform(1, 2);
-    scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
+    double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
+    startTimer(electionTimeoutExpired, randomTimeout);
 }
 
 void Server::startAcceptVoteRequestCountdown()
 {
     acceptVoteRequest = false;
+    // the leader is alive: the PreVote round in progress, if any, is abandoned
+    preVotePhase = false;
 
-    cancelEvent(minElectionTimeoutExpired);
-
-    minElectionTimeoutExpired = new cMessage("minElectionCountodwn");
-    scheduleAt(simTime() + 1, minElectionTimeoutExpired);
+    startTimer(minElectionTimeoutExpired, minElectionTimeout);
 }
 
 
@@ -907,98 +1775,434 @@ int Server::getIndex(int address)
         return address - numClient - 1; // -1 it is because of the configuration manager
 }
 
+// Raft index of the last entry in the log (entries compacted into the snapshot included)
+int Server::getLastLogIndex() const
+{
+    return logEntries.getLastIndex();
+}
+
+// Entry at the given Raft index, which must not be compacted yet (index >= logEntries.getStartIndex())
+const log_entry& Server::getLogEntry(int index) const
+{
+    return logEntries.getEntry(index);
+}
+
+// Term of the entry at the given Raft index: the last compacted entry is still known through the snapshot
+int Server::getLogTerm(int index) const
+{
+    if (index == lastSnapshot.lastIncludedIndex)
+    {
+        return lastSnapshot.lastIncludedTerm;
+    }
+    return getLogEntry(index).entryTerm;
+}
+
+// LOG COMPACTION: the applied state replaces the log prefix up to lastApplied
+void Server::takeSnapshot()
+{
+    if (lastApplied <= lastSnapshot.lastIncludedIndex)
+    {
+        return;
+    }
+    EV << "Taking snapshot up to index " + to_string(lastApplied) + "\n";
+    lastSnapshot.lastIncludedTerm = getLogTerm(lastApplied);
+    lastSnapshot.lastAppliedEntryTime = lastAppliedEntryTime;
+    lastSnapshot.lastIncludedIndex = lastApplied;
+    stateMachine->takeSnapshot(lastSnapshot.stateMachineData);
+    lastSnapshot.configuration = configurationAt(lastApplied);
+    lastSnapshot.requestTable = requestTable;
+    logEntries.discardUpTo(lastApplied);
+    if (persistentLog)
+    {
+        logSegments.discardUpTo(lastApplied);
+        wal.rewrite(lastSnapshot, logEntries, currentTerm, lastVotedTerm);
+    }
+}
+
+// The configuration takes effect when its entry is appended: the configuration as of index is the
+// current one without the changes logged after index (they may still be uncommitted)
+vector<int> Server::configurationAt(int index)
+{
+    vector<int> result = configuration;
+    for (int i = getLastLogIndex(); i > index; i--)
+    {
+        const log_entry &entry = getLogEntry(i);
+        if (entry.addressServerToAdd >= 0)
+        {
+            result.erase(remove(result.begin(), result.end(), entry.addressServerToAdd), result.end());
+        }
+        else if (entry.addressServerToRemove >= 0
+                and find(result.begin(), result.end(), entry.addressServerToRemove) == result.end())
+        {
+            result.push_back(entry.addressServerToRemove);
+        }
+    }
+    return result;
+}
+
+// Installs a snapshot received from the leader
+void Server::restoreSnapshot(state_snapshot snapshot)
+{
+    // stale snapshot: this server already compacted beyond it
+    if (snapshot.lastIncludedIndex <= lastSnapshot.lastIncludedIndex)
+    {
+        return;
+    }
+    bool keepSuffix = snapshot.lastIncludedIndex <= getLastLogIndex() and getLogTerm(snapshot.lastIncludedIndex) == snapshot.lastIncludedTerm;
+    if (keepSuffix)
+    {
+        // the log already contains the last entry of the snapshot: keep the entries that follow it
+        logEntries.discardUpTo(snapshot.lastIncludedIndex);
+    }
+    else
+    {
+        // the whole log is either older than the snapshot or in conflict with it
+        logEntries.reset(snapshot.lastIncludedIndex + 1);
+        configuration = snapshot.configuration;
+    }
+    lastSnapshot = snapshot;
+
+    if (snapshot.lastIncludedIndex > lastApplied)
+    {
+        stateMachine->restoreSnapshot(snapshot.stateMachineData);
+        requestTable = snapshot.requestTable;
+        lastAppliedEntryTime = snapshot.lastAppliedEntryTime;
+        lastApplied = snapshot.lastIncludedIndex;
+    }
+    if (snapshot.lastIncludedIndex > commitIndex)
+    {
+        commitIndex = snapshot.lastIncludedIndex;
+    }
+    if (persistentLog)
+    {
+        // the mapped segments follow the same decision as logEntries
+        if (keepSuffix)
+        {
+            logSegments.discardUpTo(snapshot.lastIncludedIndex);
+        }
+        else
+        {
+            logSegments.reset(snapshot.lastIncludedIndex + 1);
+        }
+        ASSERT(logSegments.getStartIndex() == logEntries.getStartIndex() && logSegments.getLastIndex() == getLastLogIndex());
+        wal.rewrite(lastSnapshot, logEntries, currentTerm, lastVotedTerm);
+    }
+}
+
+// Sends the last snapshot to a follower that is missing entries already compacted
+void Server::sendSnapshot(int followerAddr)
+{
+    int followerIndex = getIndex(followerAddr);
+    InstallSnapshot *installSnapshotMsg = new InstallSnapshot("InstallSnapshot");
+    installSnapshotMsg->setLeaderAddress(networkAddress);
+    installSnapshotMsg->setDestAddress(followerAddr);
+    installSnapshotMsg->setLeaderCurrentTerm(currentTerm);
+    installSnapshotMsg->setSnapshotData(lastSnapshot);
+
+    if (pipelineAppends)
+    {
+        // optimistic: assume the snapshot will be installed and move nextIndex past it
+        inflight_append append;
+        append.firstIndex = nextIndex[followerIndex];
+        append.lastIndex = lastSnapshot.lastIncludedIndex;
+        append.sendTime = simTime();
+        inflightAppends[followerIndex].push_back(append);
+        nextIndex[followerIndex] = lastSnapshot.lastIncludedIndex + 1;
+    }
+    if(gate("gateServer$o", 0)->isConnected())
+        send(installSnapshotMsg, "gateServer$o", 0);
+}
+
 // If there exists an N such that N > commitIndex, a majority of matchIndex[i] >= N,
 // and log[N].term == currentTerm: set commitIndex = N
 void Server::updateCommitIndexOnLeader()
 {
-    int lastLogEntryIndex = logEntries.size() - 1;
-    int counter = 0;
     int majority = numberVotingMembers / 2;
-    int temp, serialNumber, clientAddr;
+    int serialNumber, clientAddr;
 
-    if (lastLogEntryIndex > commitIndex)
+    if (matchIndex.size() <= majority)
     {
-        for (int i = commitIndex + 1; i <= lastLogEntryIndex; i++)
+        return;
+    }
+    // N is the (majority + 1)-th largest matchIndex: it is the highest index stored by more than a majority
+    sortedMatchIndex.assign(matchIndex.begin(), matchIndex.end());
+    nth_element(sortedMatchIndex.begin(), sortedMatchIndex.begin() + majority, sortedMatchIndex.end(), greater<int>());
+    int quorumIndex = min(sortedMatchIndex[majority], getLastLogIndex());
+
+    // terms never decrease along the log: if log[N].term != currentTerm no index below N qualifies either
+    if (quorumIndex > commitIndex and getLogTerm(quorumIndex) == currentTerm)
+    {
+        int firstNewlyCommitted = commitIndex + 1;
+        commitIndex = quorumIndex;
+        // acknowledge the whole newly committed range in one pass
+        for (int i = firstNewlyCommitted; i <= commitIndex; i++)
         {
-            temp = countGreaterOrEqual(i);
-            if (temp > majority and logEntries[i].entryTerm == currentTerm and counter < majority)
+            clientAddr = getLogEntry(i).clientAddress;
+            serialNumber = getLogEntry(i).serialNumber;
+            // but only if it is a real request from a client and not a NOP,
+            // reads are answered once applied, together with their result
+            if(clientAddr != NO_CLIENT and !stateMachine->isReadOnly(getLogEntry(i).operation))
             {
-                for (int nextCommitIndex = commitIndex + 1; nextCommitIndex <= i; nextCommitIndex++)
-                {
-                    commitIndex = nextCommitIndex;
-                    // here we update the hash table, registering the new commit
-                    clientAddr = logEntries[nextCommitIndex].clientAddress;
-                    serialNumber = logEntries[nextCommitIndex].serialNumber;
-                    // but only if it is a real request from a client and not a NOP
-                    if(clientAddr != NO_CLIENT)
-                    {
-                        sendResponseToClient(clientAddr, serialNumber, true, false);
-                    }
-                }
-                // this additional variable allows to exit the loop earlier
-                counter = counter + temp;
+                sendResponseToClient(clientAddr, serialNumber, true, false);
             }
         }
+        scheduleApply();
+    }
+}
+
+// APPLY ON COMMIT: the committed entries are applied in a separate event right after commitIndex moves
+void Server::scheduleApply()
+{
+    if (lastApplied < commitIndex && !applyBatchMsg->isScheduled())
+    {
+        startTimer(applyBatchMsg, 0);
     }
 }
 
-int Server::countGreaterOrEqual(int threshold)
+// Applies at most maxApplyBatch committed entries: a large commit jump is split over several events
+void Server::applyCommittedEntries()
 {
-    int i;
-    int count = 0;
-    for (i = 0; i < matchIndex.size(); i++)
+    int applied = 0;
+    while (lastApplied < commitIndex && applied < maxApplyBatch)
     {
-        if(matchIndex[i] >= threshold)
+        log_entry nextToApply = getLogEntry(lastApplied + 1);
+        state_machine_result result;
+        if (updateState(nextToApply, result) and serverState == LEADER and stateMachine->isReadOnly(nextToApply.operation))
         {
-            count++;
+            sendResultToClient(nextToApply.clientAddress, nextToApply.serialNumber, result);
         }
+        // update table, but ignore the NOP
+        if(nextToApply.clientAddress != NO_CLIENT)
+        {
+            // the session is (re)registered by the log if this server does not have it
+            last_req* session = getLastRequest(nextToApply.clientAddress);
+            if (session == nullptr)
+            {
+                session = addNewRequestEntry(nextToApply.clientAddress);
+            }
+            markSerialSeen(session->lastAppliedSerial, session->appliedWindow, nextToApply.serialNumber);
+            session->lastActivity = nextToApply.entryTime;
+        }
+        expireSessions(nextToApply.entryTime);
+        lastApplied++;
+        applied++;
     }
-    return count;
+    // LOG COMPACTION: enough entries have been applied since the last snapshot
+    if (snapshotThreshold > 0 && lastApplied - lastSnapshot.lastIncludedIndex >= snapshotThreshold)
+    {
+        takeSnapshot();
+    }
+    serveConfirmedReads();
+    scheduleApply();
 }
 
-// This function checks whether a request is being processed twice
-bool Server::needsToBeProcessed(int serialNumber, int clientAddress)
+////
+// READ INDEX: a heartbeat round confirms that this server is still the leader for all the reads
+// that arrived before the round started; each read is then answered once lastApplied reaches
+// the commitIndex recorded on arrival
+void Server::startReadRound()
 {
-    if(clientAddress == NO_CLIENT)
-        return false;
-    last_req* lastReq = getLastRequest(clientAddress);
-    if (lastReq->lastAppliedSerial < serialNumber)
-        return true;
-    return false;
+    readRoundCounter++;
+    readRoundInFlight = readRoundCounter;
+    readRoundsStarted++;
+    readRoundAcks.clear();
+    for (int i = 0; i < configuration.size(); i++)
+    {
+        if (configuration[i] != networkAddress)
+        {
+            sendAppendEntries(configuration[i]);
+        }
+    }
+    // with a single voting member the round is already confirmed
+    checkReadRound();
 }
 
-void Server::updateState(log_entry log)
+void Server::acknowledgeReadRound(int followerAddr)
 {
-    int *variable;
-    int logSerNum = log.serialNumber;
-    int logClientAddr = log.clientAddress;
+    // only voting members count, and each of them once
+    if (find(configuration.begin(), configuration.end(), followerAddr) == configuration.end()
+            || find(readRoundAcks.begin(), readRoundAcks.end(), followerAddr) != readRoundAcks.end())
+    {
+        return;
+    }
+    readRoundAcks.push_back(followerAddr);
+    checkReadRound();
+}
 
-    if (needsToBeProcessed(logSerNum, logClientAddr) && (log.addressServerToAdd < 0 && log.addressServerToRemove < 0))
+void Server::checkReadRound()
+{
+    int majority = numberVotingMembers / 2;
+    if (readRoundInFlight == 0 || readRoundAcks.size() + 1 <= majority)
+    {
+        return;
+    }
+    lastConfirmedReadRound = readRoundInFlight;
+    readRoundInFlight = 0;
+    serveConfirmedReads();
+    // the reads arrived during this round need a new one
+    if (!pendingReads.empty() && pendingReads.back().readRound > lastConfirmedReadRound)
+    {
+        startReadRound();
+    }
+}
+
+void Server::serveConfirmedReads()
+{
+    int i = 0;
+    while (i < pendingReads.size())
     {
-        // FSM variable choice
-        if (log.operandName == 'X')
+        pending_read &read = pendingReads[i];
+        if (read.forFollower && read.readRound <= lastConfirmedReadRound)
         {
-            variable = &var_X;
+            // the follower waits for its own lastApplied
+            sendReadIndexResponse(read.clientAddress, read.serialNumber, read.readIndex, true);
+            pendingReads.erase(pendingReads.begin() + i);
         }
-        else
+        else if (!read.forFollower && read.readRound <= lastConfirmedReadRound && read.readIndex <= lastApplied)
         {
-            variable = &var_Y;
+            state_machine_result result;
+            stateMachine->read(read.command, result);
+            sendResultToClient(read.clientAddress, read.serialNumber, result);
+            if (serverState == LEADER)
+                readIndexReadsServed++;
+            else
+                followerReadsServed++;
+            pendingReads.erase(pendingReads.begin() + i);
         }
-
-        // FSM variable update
-        if (log.operation == 'S')
+        else
         {
-            (*variable) = log.operandValue;
+            i++;
         }
-        else if (log.operation == 'A')
+    }
+}
+
+// LEASE: the leader holds it while a majority (itself included) answered heartbeats sent less than
+// minElectionTimeout - leaseDriftBound ago: none of those followers can have voted for someone else since
+bool Server::hasValidLease()
+{
+    int majority = numberVotingMembers / 2;
+    vector<double> sentAt;
+    for (int i = 0; i < configuration.size(); i++)
+    {
+        int followerIndex = getIndex(configuration[i]);
+        if (configuration[i] != networkAddress && followerIndex < leaseAckSentAt.size())
         {
-            (*variable) = (*variable) + log.operandValue;
+            sentAt.push_back(leaseAckSentAt[followerIndex]);
         }
-        else if (log.operation == 'M')
+    }
+    // the leader counts for itself, it needs majority more followers
+    if (majority == 0)
+    {
+        return true;
+    }
+    if (sentAt.size() < majority)
+    {
+        return false;
+    }
+    nth_element(sentAt.begin(), sentAt.begin() + majority - 1, sentAt.end(), greater<double>());
+    double leaseStart = sentAt[majority - 1];
+    return leaseStart >= 0 && simTime() < leaseStart + minElectionTimeout - leaseDriftBound;
+}
+
+void Server::invalidateLease()
+{
+    leaseAckSentAt.clear();
+}
+
+// Leadership lost: the pending reads cannot be confirmed anymore, the clients will retry
+void Server::failPendingReads()
+{
+    for (int i = 0; i < pendingReads.size(); i++)
+    {
+        if (pendingReads[i].forFollower)
+            sendReadIndexResponse(pendingReads[i].clientAddress, pendingReads[i].serialNumber, -1, false);
+        else
+            sendResponseToClient(pendingReads[i].clientAddress, pendingReads[i].serialNumber, false, false);
+    }
+    pendingReads.clear();
+    readRoundAcks.clear();
+    readRoundInFlight = 0;
+    stopTimer(readIndexTimeout);
+}
+
+// FOLLOWER READS: a single request to the leader covers all the reads arrived since the previous one
+void Server::sendReadIndexRequest()
+{
+    readRoundCounter++;
+    readRoundInFlight = readRoundCounter;
+    ReadIndexRequest *request = new ReadIndexRequest("ReadIndexRequest");
+    request->setFollowerAddress(networkAddress);
+    request->setDestAddress(leaderAddress);
+    request->setRequestId(readRoundInFlight);
+    if(gate("gateServer$o", 0)->isConnected())
+        send(request, "gateServer$o", 0);
+    startTimer(readIndexTimeout, minElectionTimeout);
+}
+
+void Server::sendReadIndexResponse(int followerAddr, int requestId, int readIndex, bool succeded)
+{
+    ReadIndexResponse *response = new ReadIndexResponse("ReadIndexResponse");
+    response->setLeaderAddress(networkAddress);
+    response->setDestAddress(followerAddr);
+    response->setRequestId(requestId);
+    response->setReadIndex(readIndex);
+    response->setSucceded(succeded);
+    if(gate("gateServer$o", 0)->isConnected())
+        send(response, "gateServer$o", 0);
+}
+
+// SESSION EXPIRY: driven by the log time of the applied entries, so every replica removes the
+// same sessions at the same log index. The table is scanned each time the log time crosses a
+// multiple of sessionTTL / 2; sessions never applied on this server (lastActivity < 0) are kept
+void Server::expireSessions(double logTime)
+{
+    double previousTime = lastAppliedEntryTime;
+    lastAppliedEntryTime = logTime;
+    if (sessionTTL <= 0 || floor(logTime / (sessionTTL / 2)) <= floor(previousTime / (sessionTTL / 2)))
+    {
+        return;
+    }
+    vector<int> expired;
+    requestTable.forEach([&](const last_req &session) {
+        if (session.lastActivity >= 0 && session.lastActivity < logTime - sessionTTL)
         {
-            (*variable) = (*variable) * log.operandValue;
+            expired.push_back(session.clientAddress);
         }
+    });
+    for (int i = 0; i < expired.size(); i++)
+    {
+        requestTable.remove(expired[i]);
+    }
+    expiredSessions = expiredSessions + expired.size();
+    if (!expired.empty())
+    {
+        EV << "Expired " + to_string(expired.size()) + " client sessions, " + to_string(requestTable.size()) + " left\n";
+    }
+}
+
+// This function checks whether a request is being processed twice
+bool Server::needsToBeProcessed(int serialNumber, int clientAddress)
+{
+    if(clientAddress == NO_CLIENT)
+        return false;
+    last_req* lastReq = getLastRequest(clientAddress);
+    if (lastReq == nullptr or !serialSeen(lastReq->lastAppliedSerial, lastReq->appliedWindow, serialNumber))
+        return true;
+    return false;
+}
+
+// Applies the entry to the state machine, unless it is a NOP, a configuration change or a duplicate
+bool Server::updateState(log_entry log, state_machine_result &result)
+{
+    int logSerNum = log.serialNumber;
+    int logClientAddr = log.clientAddress;
+
+    if (needsToBeProcessed(logSerNum, logClientAddr) && (log.addressServerToAdd < 0 && log.addressServerToRemove < 0))
+    {
+        stateMachine->apply(log, result);
+        return true;
     }
+    return false;
 }
 
 void Server::initializeConfiguration()
@@ -1021,101 +2225,96 @@ void Server::initializeConfiguration()
     }
 }
 
-std::ostream& operator<<(std::ostream& stream, const vector<log_entry> logEntries)
-{
-    for (int index = 0; index < logEntries.size(); index++)
-    {
-        stream << "[I: "
-                << logEntries[index].entryLogIndex
-                << ",T:"
-                << logEntries[index].entryTerm
-                << ",VAR:"
-                << logEntries[index].operandName
-                << ",OP:"
-                << logEntries[index].operation
-                << ",VAL:"
-                << logEntries[index].operandValue
-                << "] ";
-    }
-    return stream;
-}
-
-
 void Server::stepdown(int newCurrentTerm)
 {
-    cancelEvent(electionTimeoutExpired);
-    cancelEvent(heartBeatsReminder);
+    stopLeading();
     cDisplayString &dispStr = getDisplayString();
     dispStr.parse("i=device/server2,bronze");
     currentTerm = newCurrentTerm;
     numberVoteReceived = 0;
     serverState = FOLLOWER;
     // alreadyVoted = false;
-    electionTimeoutExpired = new cMessage("NewElectionTimeoutExpired");
     double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
-    scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
+    startTimer(electionTimeoutExpired, randomTimeout);
+}
+
+// Everything a leader keeps only while it leads: called by every path that ends the leadership
+// (stepdown, crash, loss of the link), and harmless on a server that is not the leader
+void Server::stopLeading()
+{
+    failPendingReads();
+    dropProposals();
+    invalidateLease();
+    appendSentAt.clear();
+    commitIndexSent.clear();
+    stopTimer(checkQuorumMsg);
+    stopTimer(heartBeatsReminder);
+    stopTimer(replicateEntriesMsg);
 }
 
-void Server::initializeRequestTable(int size)
+// CheckQuorum: the leader counts the voting members that answered during the last window (itself included).
+// Without a majority it cannot commit anything, so it steps down and stops accepting client requests
+void Server::checkLeaderQuorum()
 {
-    vector<last_req> chainToAdd;
-    for (int i = 0; i < size; i++)
+    if (serverState != LEADER)
     {
-        requestTable.entries.push_back(chainToAdd);
+        return;
     }
-    requestTable.size = size;
+    int responders = 0;
+    for (int i = 0; i < configuration.size(); i++)
+    {
+        if (configuration[i] == networkAddress
+                or find(quorumResponders.begin(), quorumResponders.end(), configuration[i]) != quorumResponders.end())
+        {
+            responders++;
+        }
+    }
+    quorumResponders.clear();
+    if (responders > numberVotingMembers / 2)
+    {
+        startTimer(checkQuorumMsg, minElectionTimeout);
+        return;
+    }
+    bubble("quorum lost: stepdown");
+    EV << "Server: only " + to_string(responders) + " voting members answered, the leader steps down\n";
+    quorumStepdowns++;
+    stepdown(currentTerm);
+    leaderAddress = -1;
 }
 
 last_req* Server::addNewRequestEntry(int clientAddr)
 {
-    int mod = clientAddr % requestTable.size;
-    int newElementIndex = requestTable.entries[mod].size();
-
-    last_req toAdd;
-    toAdd.clientAddress = clientAddr;
-
-    requestTable.entries[mod].push_back(toAdd);
-    return &requestTable.entries[mod][newElementIndex];
+    return requestTable.insert(clientAddr);
 }
 
 last_req* Server::getLastRequest(int clientAddr)
 {
-    int mod = clientAddr % requestTable.size;
-    int chainSize = requestTable.entries[mod].size();
-    int index;
-    for (index = 0; index < chainSize; index++)
-    {
-        if (requestTable.entries[mod][index].clientAddress == clientAddr)
-        {
-            return &requestTable.entries[mod][index];
-        }
-    }
-    return nullptr;
+    return requestTable.find(clientAddr);
 }
 
 void Server::refreshDisplay() const {
     char buf[180];
     string logEntriesFormat = "";
     int startIndex = lastApplied + 1;
-    for (int index = startIndex; index < logEntries.size(); index++)
+    for (int index = startIndex; index <= getLastLogIndex(); index++)
     {
         logEntriesFormat = logEntriesFormat
                 + "[I: "
-                + to_string(logEntries[index].entryLogIndex)
+                + to_string(getLogEntry(index).entryLogIndex)
                 + ",T:"
-                + to_string(logEntries[index].entryTerm)
+                + to_string(getLogEntry(index).entryTerm)
                 + ",VAR:"
-                + logEntries[index].operandName
+                + getLogEntry(index).operandName
                 + ",OP:"
-                + logEntries[index].operation
+                + getLogEntry(index).operation
                 + ",VAL:"
-                + to_string(logEntries[index].operandValue)
+                + to_string(getLogEntry(index).operandValue)
                 + "] \n";
     }
-    logEntriesFormat = logEntriesFormat + "currentTerm: %ld\n commitIndex: %ld\n lastApplied: %ld\n X==%ld; Y==%ld";
+    logEntriesFormat = logEntriesFormat + "currentTerm: %ld\n commitIndex: %ld\n lastApplied: %ld\n " + stateMachine->describe();
     char * cstr = new char [logEntriesFormat.length() + 1];
     strcpy(cstr, logEntriesFormat.c_str());
-    sprintf(buf, cstr, currentTerm, commitIndex, lastApplied, var_X, var_Y);
+    sprintf(buf, cstr, currentTerm, commitIndex, lastApplied);
     getDisplayString().setTagArg("t", 0, buf);
 }
 
@@ -1132,18 +2331,17 @@ void Server::startMembershipChangeProcedure(log_entry changeConfigEntry)
         int serverIndex = getIndex(changeConfigEntry.addressServerToAdd);
         if (serverIndex >= matchIndex.size())
         {
-            nextIndex.push_back(logEntries.size());
+            nextIndex.push_back(getLastLogIndex() + 1);
             matchIndex.push_back(-1);
+            inflightAppends.push_back(vector<inflight_append>());
         }
         catchUpPhaseRunning = true;
         catchUpRoundNumber = 0;
-        catchUpTargetIndex = logEntries.size() - 1;
+        catchUpTargetIndex = getLastLogIndex();
         bubble("ROUND 0");
         EV << "ROUND 0";
-        catchUpRoundTimeout = new cMessage("Round timeout expired");
-        scheduleAt(simTime() + maxElectionTimeout, catchUpRoundTimeout);
-        cancelEvent(heartBeatsReminder);
-        scheduleAt(simTime(), heartBeatsReminder);
+        startTimer(catchUpRoundTimeout, maxElectionTimeout);
+        startTimer(heartBeatsReminder, 0);
     }
     else
     {
@@ -1159,16 +2357,16 @@ void Server::startMembershipChangeProcedure(log_entry changeConfigEntry)
             EV << "Removing server" + to_string(getIndex(toDel)) + "\n";
             configuration.erase(remove(configuration.begin(), configuration.end(), toDel), configuration.end());
             nextIndex[getIndex(networkAddress)]++;
-            matchIndex[getIndex(networkAddress)]++;
             numberVotingMembers  = configuration.size();
-            logEntries.push_back(changeConfigEntry);
+            appendToLog(changeConfigEntry);
+            scheduleReplication();
         }
     }
 }
 
 void Server::configureServer(vector<int> initialConfiguration)
 {
-    cancelEvent(electionTimeoutExpired);
+    stopTimer(electionTimeoutExpired);
     configuration = initialConfiguration;
 
     serverState= NON_VOTING_MEMBER;
@@ -1177,10 +2375,12 @@ void Server::configureServer(vector<int> initialConfiguration)
 
     nextIndex.clear();
     matchIndex.clear();
+    inflightAppends.clear();
     for (int i = 0; i < configuration.size(); ++i)
     {
         nextIndex.push_back(0);
         matchIndex.push_back(-1);
+        inflightAppends.push_back(vector<inflight_append>());
     }
 }
 
@@ -1204,37 +2404,68 @@ void Server::endCatchUpRound()
             // send NACK: unsuccessful catch up
             // before sending the NACK the leader decrement the value of the last request entry so that it can be processed again
             last_req* lastReqHashEntry = getLastRequest(changingServerEntry.clientAddress);
-            lastReqHashEntry->lastAppliedSerial--;
+            forgetSerial(lastReqHashEntry->lastArrivedSerial, lastReqHashEntry->arrivedWindow, serial);
             sendResponseToClient(managerAddr, serial, false, false);
         }
         else
         {
             // next round
-            catchUpTargetIndex = logEntries.size() - 1;
-            catchUpRoundTimeout = new cMessage("Round timeout expired");
-            scheduleAt(simTime() + maxElectionTimeout, catchUpRoundTimeout);
+            catchUpTargetIndex = getLastLogIndex();
+            startTimer(catchUpRoundTimeout, maxElectionTimeout);
         }
 
     }
     else
     {
         // SUCCESSFUL CATCH UP
-        cancelEvent(catchUpRoundTimeout);
+        stopTimer(catchUpRoundTimeout);
         catchUpPhaseRunning = false;
         catchUpCountdownEnded = false;
         // SUCCESSFUL catch up phase.
         // START CLUSTER MEMBERSHIP PHASE
-        changingServerEntry.entryLogIndex = logEntries.size();
-        logEntries.push_back(changingServerEntry);
+        changingServerEntry.entryLogIndex = getLastLogIndex() + 1;
+        appendToLog(changingServerEntry);
         last_req* lastRequestFromClient = getLastRequest(changingServerEntry.clientAddress);
-        lastRequestFromClient->lastLoggedIndex = logEntries.size() - 1;
+        lastRequestFromClient->lastLoggedIndex = getLastLogIndex();
         configuration.push_back(changingServerEntry.addressServerToAdd);
+        scheduleReplication();
+    }
+}
+
+// PreVote round: the term is left untouched, the election starts only once a majority of the voting
+// members answers that it would grant the vote (so a partitioned or recovering server cannot disrupt the leader)
+void Server::startPreVote()
+{
+    bubble("timeout expired, pre-vote");
+    preVotePhase = true;
+    preVoteRounds++;
+    preVoters.clear();
+    preVoters.push_back(networkAddress);
+    // if the round does not succeed a new one is started at the next timeout
+    double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
+    startTimer(electionTimeoutExpired, randomTimeout);
+    if (preVoters.size() > numberVotingMembers / 2)
+    {
+        preVotePhase = false;
+        startNewElection(false);
+        return;
     }
+
+    PreVoteRequest *preVoteRequest = new PreVoteRequest("preVoteRequest");
+    preVoteRequest->setCandidateAddress(networkAddress);
+    preVoteRequest->setNextTerm(currentTerm + 1);
+    int lastLogIndex = getLastLogIndex();
+    preVoteRequest->setLastLogIndex(lastLogIndex);
+    preVoteRequest->setLastLogTerm(getLogTerm(lastLogIndex));
+    if(gate("gateServer$o", 0)->isConnected())
+        send(preVoteRequest, "gateServer$o", 0);
 }
 
 void Server::startNewElection(bool disruptPermitted)
 {
-    cancelEvent(heartBeatsReminder);
+    electionsStarted++;
+    // a leader gets here too (response of a later term, TimeOutNow): its leader state goes away
+    stopLeading();
     // New election needed
     bubble("timeout expired, new election start");
     cDisplayString &dispStr = getDisplayString();
@@ -1246,37 +2477,75 @@ void Server::startNewElection(bool disruptPermitted)
     // this->alreadyVoted = true; // each server can vote just one time per election; if the server is in a candidate state it vote for himself
     lastVotedTerm = currentTerm;
     // i set a new timeout range
-    electionTimeoutExpired = new cMessage("NewElectionTimeoutExpired");
     double randomTimeout = uniform(minElectionTimeout, maxElectionTimeout);
-    scheduleAt(simTime() + randomTimeout, electionTimeoutExpired);
+    startTimer(electionTimeoutExpired, randomTimeout);
 
     // send broadcast vote request to the switch
     VoteRequest *voteRequest = new VoteRequest("voteRequest");
     voteRequest->setCandidateAddress(networkAddress);
     voteRequest->setCurrentTerm(currentTerm);
     voteRequest->setDisruptLeaderPermission(disruptPermitted);
-    int lastLogIndex = logEntries.size() - 1;
+    int lastLogIndex = getLastLogIndex();
     voteRequest->setLastLogIndex(lastLogIndex);
-    if (!(lastLogIndex < 0))
+    voteRequest->setLastLogTerm(getLogTerm(lastLogIndex));
+    sendDurably(voteRequest);
+}
+
+void Server::finish()
+{
+    recordTimerStatistics();
+
+    // received messages of each kind
+    for (int kind = 1; kind < MESSAGE_KINDS; kind++)
     {
-        voteRequest->setLastLogTerm(logEntries[lastLogIndex].entryTerm);
+        if (receivedMessages[kind] > 0)
+            recordScalar((string("received:") + messageKindName(kind)).c_str(), receivedMessages[kind]);
     }
-    else
+
+    // client sessions kept for deduplication
+    recordScalar("liveSessions", requestTable.size());
+    recordScalar("sessionTableBytes", requestTable.memoryUsage());
+    recordScalar("expiredSessions", expiredSessions);
+
+    if (preVote)
     {
-        voteRequest->setLastLogTerm(0);
+        recordScalar("preVoteRounds", preVoteRounds);
+    }
+    recordScalar("electionsStarted", electionsStarted);
+    if (checkQuorum)
+    {
+        recordScalar("quorumStepdowns", quorumStepdowns);
     }
-    if(gate("gateServer$o", 0)->isConnected())
-        send(voteRequest, "gateServer$o", 0);
-}
 
-void Server::finish()
-{
-    cancelAndDelete(failureMsg);
-    cancelAndDelete(recoveryMsg);
-    cancelAndDelete(electionTimeoutExpired);
-    cancelAndDelete(heartBeatsReminder);
-    cancelAndDelete(applyChangesMsg);
-    cancelAndDelete(leaderTransferFailed);
-    cancelAndDelete(minElectionTimeoutExpired);
-    cancelAndDelete(catchUpRoundTimeout);
+    if (suppressHeartbeats)
+    {
+        recordScalar("suppressedHeartbeats", suppressedHeartbeats);
+    }
+
+    if (maxProposalBatch > 1)
+    {
+        recordScalar("proposalBatches", proposalBatches);
+        if (proposalBatches > 0)
+            recordScalar("proposalsPerBatch", (double) batchedProposals / proposalBatches);
+    }
+
+    if (readIndexReads)
+    {
+        recordScalar("readRoundsStarted", readRoundsStarted);
+        recordScalar("readIndexReadsServed", readIndexReadsServed);
+        recordScalar("leaseReadsServed", leaseReadsServed);
+        recordScalar("followerReadsServed", followerReadsServed);
+    }
+
+    if (persistentLog)
+    {
+        // cost of persistence
+        recordScalar("walFsyncCount", wal.getFsyncCount());
+        recordScalar("walBytesWritten", wal.getBytesWritten());
+        if (commitIndex >= 0)
+        {
+            recordScalar("walFsyncsPerCommittedEntry", (double) wal.getFsyncCount() / (commitIndex + 1));
+            recordScalar("walBytesPerCommittedEntry", (double) wal.getBytesWritten() / (commitIndex + 1));
+        }
+    }
 }
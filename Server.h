@@ -14,6 +14,17 @@
 #include "HeartBeat_m.h"
 #include "HeartBeatResponse_m.h"
 #include "TimeOutNow_m.h"
+#include "InstallSnapshot_m.h"
+#include "ReadIndexRequest_m.h"
+#include "ReadIndexResponse_m.h"
+#include "PreVoteRequest_m.h"
+#include "PreVoteReply_m.h"
+#include "MessageKinds.h"
+#include "RaftLog.h"
+#include "WriteAheadLog.h"
+#include "LogSegments.h"
+#include "StateMachine.h"
+#include "TimerModule.h"
 
 using namespace omnetpp;
 using std::vector;
@@ -22,11 +33,13 @@ using std::string;
 using std::to_string;
 using std::count;
 using std::find;
+using std::nth_element;
+using std::greater;
 
 #ifndef SERVER_H_
 #define SERVER_H_
 
-class Server : public cSimpleModule
+class Server : public TimerModule
 {
     /*
      * red = server down;
@@ -37,9 +50,14 @@ class Server : public cSimpleModule
 public:
     virtual ~Server();
 private:
-    // AUTOMESSAGES
+    // AUTOMESSAGES: created once by createTimer, (re)armed with startTimer
     cMessage *electionTimeoutExpired; // autoMessage
     cMessage *heartBeatsReminder;     // if the leader receive this autoMessage it send a broadcast heartbeat
+    cMessage *replicateEntriesMsg;    // eager replication: the leader ships new entries when this autoMessage fires
+    cMessage *proposalBatchMsg;       // proposal batching: the leader appends the collected proposals when this autoMessage fires
+    cMessage *applyBatchMsg;          // apply on commit: the next batch of committed entries is applied when this autoMessage fires
+    cMessage *readIndexTimeout;       // follower reads: the pending reads fail if the leader does not answer before this autoMessage
+    cMessage *walFlushMsg;            // group commit: the pending write-ahead log records are flushed when this autoMessage fires
     cMessage *scheduleCrashMsg;
     cMessage *failureMsg;             // autoMessage to shut down this server
     cMessage *recoveryMsg;            // autoMessage to reactivate this server
@@ -47,13 +65,11 @@ private:
     cMessage *leaderTransferFailed;
     cMessage *minElectionTimeoutExpired; // a server starts accepting new vote requests only after a minimum timeout from the last heartbeat reception
     cMessage *catchUpRoundTimeout;
-    // MESSAGES
-    VoteReply *voteReply;
-    VoteRequest *voteRequest;
-    HeartBeats *heartBeat;
-    HeartBeatResponse *heartBeatResponse;
-    LogMessage *logMessage;
-    TimeOutNow *timeOutnow;
+    cMessage *checkQuorumMsg;         // CheckQuorum: at the end of each window the leader verifies that a majority answered
+    // MESSAGES: every received message is dispatched on its kind to one of the handlers below
+    typedef void (Server::*message_handler)(cMessage *msg);
+    static const message_handler messageHandlers[MESSAGE_KINDS];
+    long receivedMessages[MESSAGE_KINDS] = {0};
 
     enum stateEnum
     {
@@ -70,16 +86,43 @@ private:
     int numClient;
     bool acceptVoteRequest;
 
-    /****** STATE MACHINE VARIABLES ******/
-    int var_X;
-    int var_Y;
+    /****** PreVote: the term is incremented only if a majority would grant the vote ******/
+    bool preVote;
+    bool preVotePhase = false;  // a PreVote round is in progress
+    vector<int> preVoters;      // servers that granted the pre-vote in this round (the server itself included)
+    long preVoteRounds;
+    long electionsStarted;
+
+    /****** CheckQuorum: a leader that does not hear from a majority within minElectionTimeout steps down ******/
+    bool checkQuorum;
+    vector<int> quorumResponders; // followers that answered in the current window
+    long quorumStepdowns;
+
+    /****** STATE MACHINE ******/
+    StateMachine *stateMachine = nullptr;
+
+    /****** ReadIndex (read-only requests): on the leader the rounds are heartbeat rounds, on a follower ReadIndexRequests ******/
+    vector<pending_read> pendingReads;
+    int readRoundCounter;       // last heartbeat round started to confirm the leadership
+    int readRoundInFlight;      // round waiting for a majority of responses (0 = none)
+    int lastConfirmedReadRound;
+    vector<int> readRoundAcks;  // followers that answered the round in flight
+    long readRoundsStarted;
+    long readIndexReadsServed;
+    vector<double> leaseAckSentAt; // for each follower, sending time of the latest heartbeat it answered in this term (-1 = none)
+    long leaseReadsServed;
+    long followerReadsServed;
 
     /****** Persistent state on all servers: ******/
     int currentTerm; // Time is divided into terms, and each term begins with an election. After a successful election, a single leader
     // manages the cluster until the end of the term. Some elections fail, in which case the term ends without choosing a leader.
     int lastVotedTerm;
-    vector<log_entry> logEntries;
-    client_requests_table requestTable;
+    RaftLog logEntries;             // entries following the last snapshot, addressed by Raft index
+    state_snapshot lastSnapshot;    // applied state up to lastSnapshot.lastIncludedIndex (log compaction)
+    WriteAheadLog wal;
+    LogSegments logSegments;        // mapped copy of the log, AppendEntries are filled from it when persistentLog is set
+    vector<cMessage *> pendingDurableMsgs; // responses waiting for the next group commit
+    SessionTable requestTable;
 
     int leaderAddress;          // network address of the leader
     int numberVoteReceived = 0; // number of vote received by every server
@@ -93,6 +136,33 @@ private:
     double maxElectionTimeout;
     double applyChangesPeriod;
     double heartbeatsPeriod;
+    int maxEntriesPerAppend;    // max number of entries shipped in a single AppendEntries
+    int maxAppendBytes;         // max size (in bytes) of the entries shipped in a single AppendEntries
+    bool pipelineAppends;       // if true the leader advances nextIndex as soon as an append is sent
+    int maxInflightAppends;     // max number of unacknowledged appends per follower (pipelining only)
+    double appendTimeout;       // an in-flight append not acknowledged within this time is sent again (pipelining only)
+    bool eagerReplication;      // if true new entries are sent right after being appended, not on the next heartbeat
+    double replicationDelay;    // coalescing delay between the first new entry and the eager AppendEntries
+    bool suppressHeartbeats;    // if true the periodic heartbeat is not sent to followers contacted within the last period
+    vector<double> appendSentAt;    // for each follower, sending time of the latest AppendEntries in this term (-1 = none)
+    vector<int> commitIndexSent;    // for each follower, leaderCommit carried by the latest AppendEntries
+    long suppressedHeartbeats;
+    int maxProposalBatch;       // client requests collected by the leader before being appended together (1 = no batching)
+    double proposalBatchDelay;  // longest time a client request waits in the batch
+    vector<log_entry> pendingProposals; // client requests accepted by the leader and not yet in the log
+    long proposalBatches;
+    long batchedProposals;
+    int snapshotThreshold;      // number of applied entries that triggers a new snapshot (0 = never compact the log)
+    int maxApplyBatch;          // maximum number of committed entries applied in a single event
+    double sessionTTL;          // client sessions idle for longer than this (in log time) are removed (0 = never)
+    double lastAppliedEntryTime; // log time of the last applied entry
+    long expiredSessions;
+    bool readIndexReads;        // if true read-only requests are served by the leader without being logged
+    bool leaseReads;            // if true the leader serves read-only requests locally while it holds a lease
+    double leaseDriftBound;     // safety margin subtracted from minElectionTimeout for clock drift
+    bool followerReads;         // if true followers serve read-only requests, after asking the leader for a read index
+    bool persistentLog;         // if true term, vote and log are written to a write-ahead log and survive crashes
+    double walGroupCommitDelay; // time during which records are collected before being flushed together
     const int NO_CLIENT = -1;
 
     /****** Volatile state on all servers: ******/
@@ -102,6 +172,8 @@ private:
     /****** Volatile state on leaders (Reinitialized after election) ******/
     vector<int> nextIndex;  // for each server, index of the next log entry to send to that server (initialized to leader last log index + 1)
     vector<int> matchIndex; // for each server, index of highest log entry known to be replicated on server (initialized to 0, increases monotonically)
+    vector<int> sortedMatchIndex; // scratch copy of matchIndex used to select the commit index
+    vector<vector<inflight_append>> inflightAppends; // for each server, appends sent but not yet acknowledged (pipelining only)
 
     /****** Cluster Membership Change ******/
     log_entry changingServerEntry;
@@ -116,25 +188,77 @@ private:
     virtual void initialize() override;
 
     virtual void handleMessage(cMessage *msg) override;
+    virtual void dispatchMessage(cMessage *msg);
+    virtual void handleVoteRequest(cMessage *msg);
+    virtual void handleVoteReply(cMessage *msg);
+    virtual void handleHeartBeat(cMessage *msg);
+    virtual void handleHeartBeatResponse(cMessage *msg);
+    virtual void handleInstallSnapshot(cMessage *msg);
+    virtual void handleLogMessage(cMessage *msg);
+    virtual void handleReadOnlyRequest(LogMessage *logMessage);
+    virtual void handleTimeOutNow(cMessage *msg);
+    virtual void handleReadIndexRequest(cMessage *msg);
+    virtual void handleReadIndexResponse(cMessage *msg);
+    virtual void handlePreVoteRequest(cMessage *msg);
+    virtual void handlePreVoteReply(cMessage *msg);
     virtual void startNewElection(bool disruptPermitted);
+    virtual void startPreVote();
+    virtual bool candidateLogUpToDate(int candidateLastLogTerm, int candidateLastLogIndex);
     virtual void sendResponseToClient(int clientAddress, int serialNumber, bool succeded, bool redirect);
-    virtual void updateState(log_entry log);
-    virtual void acceptLog(int leaderAddress, int matchIndex);
+    virtual bool updateState(log_entry log, state_machine_result &result);
+    virtual void sendResultToClient(int clientAddress, int serialNumber, const state_machine_result &result);
+    virtual void sendAppendEntries(int followerAddr);
+    virtual bool heartbeatNeeded(int followerAddr);
+    virtual void scheduleReplication();
+    virtual void proposeEntry(log_entry entry);
+    virtual void flushProposals();
+    virtual void dropProposals();
+    virtual bool isProposalPending(int clientAddress, int serialNumber);
+    virtual void acceptLog(int leaderAddress, int matchIndex, HeartBeats *heartBeat = nullptr);
+    virtual void appendEntryFromLeader(log_entry entry);
     virtual void startAcceptVoteRequestCountdown();
-    virtual void rejectLog(int leaderAddress);
+    virtual void rejectLog(int leaderAddress, int prevLogIndex, HeartBeats *heartBeat = nullptr);
+    virtual void echoHeartBeat(HeartBeatResponse *reply, HeartBeats *heartBeat);
+    virtual int nextIndexAfterConflict(int conflictTerm, int conflictIndex);
     virtual void tryLeaderTransfer(int targetAddress);
     virtual void restartCountdown();
     virtual int min(int a, int b);
     virtual int getIndex(int addr);
+    virtual int getLastLogIndex() const;
+    virtual const log_entry& getLogEntry(int index) const;
+    virtual int getLogTerm(int index) const;
+    virtual void takeSnapshot();
+    virtual vector<int> configurationAt(int index);
+    virtual void restoreSnapshot(state_snapshot snapshot);
+    virtual void sendSnapshot(int followerAddr);
+    virtual void appendToLog(log_entry entry);
+    virtual void truncateLog(int fromIndex);
+    virtual void sendDurably(cMessage *msg);
+    virtual void persistTermAndVote();
+    virtual void scheduleWalFlush();
+    virtual void flushWriteAheadLog();
+    virtual void recoverFromWriteAheadLog();
     virtual void initializeConfiguration();
     virtual void refreshDisplay() const override;
     virtual void finish() override;
     virtual void stepdown(int newCurrentTerm);
+    virtual void stopLeading();
+    virtual void checkLeaderQuorum();
     virtual void updateCommitIndexOnLeader();
-    virtual int countGreaterOrEqual(int threshold);
-    virtual void initializeRequestTable(int size);
+    virtual void scheduleApply();
+    virtual void applyCommittedEntries();
+    virtual void startReadRound();
+    virtual void acknowledgeReadRound(int followerAddr);
+    virtual void checkReadRound();
+    virtual void serveConfirmedReads();
+    virtual void failPendingReads();
+    virtual bool hasValidLease();
+    virtual void invalidateLease();
+    virtual void sendReadIndexRequest();
+    virtual void sendReadIndexResponse(int followerAddr, int requestId, int readIndex, bool succeded);
     virtual last_req* getLastRequest(int clientAddr);
     virtual last_req* addNewRequestEntry(int clientAddr);
+    virtual void expireSessions(double logTime);
     virtual bool needsToBeProcessed(int serialNumber, int clientAddress);
     virtual void startMembershipChangeProcedure(log_entry changeMembershipEntry);
     virtual void endCatchUpRound();
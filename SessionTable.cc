@@ -0,0 +1,124 @@
+/*
+ * SessionTable.cc
+ *
+ *  Open-addressing table (linear probing) of the client sessions.
+ */
+#include "SessionTable.h"
+
+constexpr int SessionTable::EMPTY;
+constexpr int SessionTable::DELETED;
+constexpr int SessionTable::INITIAL_CAPACITY;
+
+SessionTable::SessionTable()
+{
+    slots.assign(INITIAL_CAPACITY, EMPTY);
+    count = 0;
+    tombstones = 0;
+}
+
+// client addresses are small consecutive integers: spread them over the table
+unsigned int SessionTable::hashAddress(int clientAddress)
+{
+    return (unsigned int) clientAddress * 2654435761u;
+}
+
+int SessionTable::findSlot(int clientAddress) const
+{
+    int mask = slots.size() - 1;
+    for (int i = hashAddress(clientAddress) & mask; ; i = (i + 1) & mask)
+    {
+        if (slots[i] == EMPTY)
+            return -1;
+        if (slots[i] >= 0 && records[slots[i]].clientAddress == clientAddress)
+            return i;
+    }
+}
+
+last_req* SessionTable::find(int clientAddress)
+{
+    int position = findSlot(clientAddress);
+    if (position < 0)
+        return nullptr;
+    return &records[slots[position]];
+}
+
+last_req* SessionTable::insert(int clientAddress)
+{
+    if (count + tombstones + 1 > MAX_LOAD * slots.size())
+    {
+        // grow only if the live sessions need it, otherwise rebuilding drops the tombstones
+        rehash(count + 1 > MAX_LOAD * slots.size() / 2 ? slots.size() * 2 : slots.size());
+    }
+    int record;
+    if (!freeRecords.empty())
+    {
+        record = freeRecords.back();
+        freeRecords.pop_back();
+        records[record] = last_req();
+    }
+    else
+    {
+        record = records.size();
+        records.push_back(last_req());
+    }
+    records[record].clientAddress = clientAddress;
+
+    int mask = slots.size() - 1;
+    int i = hashAddress(clientAddress) & mask;
+    while (slots[i] >= 0)
+        i = (i + 1) & mask;
+    if (slots[i] == DELETED)
+        tombstones--;
+    slots[i] = record;
+    count++;
+    return &records[record];
+}
+
+bool SessionTable::remove(int clientAddress)
+{
+    int position = findSlot(clientAddress);
+    if (position < 0)
+        return false;
+    freeRecords.push_back(slots[position]);
+    slots[position] = DELETED;
+    count--;
+    tombstones++;
+    return true;
+}
+
+void SessionTable::clear()
+{
+    slots.assign(INITIAL_CAPACITY, EMPTY);
+    records.clear();
+    freeRecords.clear();
+    count = 0;
+    tombstones = 0;
+}
+
+int SessionTable::size() const
+{
+    return count;
+}
+
+size_t SessionTable::memoryUsage() const
+{
+    return slots.capacity() * sizeof(int) + records.size() * sizeof(last_req) + freeRecords.capacity() * sizeof(int);
+}
+
+void SessionTable::rehash(int newCapacity)
+{
+    std::vector<int> old;
+    old.swap(slots);
+    slots.assign(newCapacity, EMPTY);
+    int mask = newCapacity - 1;
+    for (size_t j = 0; j < old.size(); j++)
+    {
+        if (old[j] < 0)
+            continue;
+        int i = hashAddress(records[old[j]].clientAddress) & mask;
+        while (slots[i] >= 0)
+            i = (i + 1) & mask;
+        slots[i] = old[j];
+    }
+    tombstones = 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * SessionTable.h
+ *
+ *  Deduplication state of the clients (one last_req per client), in a flat open-addressing
+ *  table keyed by client address. Records live in a deque that never moves them, so the
+ *  last_req* returned by find() and insert() stay valid until that session is removed.
+ */
+#ifndef SESSIONTABLE_H_
+#define SESSIONTABLE_H_
+
+#include <deque>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// A client may have up to SERIAL_WINDOW requests in flight: the serials below the highest one seen are
+// tracked in a bitmap (bit i = highest - i), anything older than the window counts as already seen
+#define SERIAL_WINDOW 64
+
+struct last_req {
+    int clientAddress;
+    int lastArrivedSerial = 0;     // highest serial number arrived from this client. It may either be in the log or not (change membership messages are stored later on)
+    uint64_t arrivedWindow = 0;     // serials arrived below lastArrivedSerial
+    int lastLoggedIndex = -1;       // index of the last entry added to the log
+    int lastAppliedSerial = 0;
+    uint64_t appliedWindow = 0;     // serials applied below lastAppliedSerial
+    double lastActivity = -1;       // log time of the last entry of this client applied (-1 = none yet)
+};
+
+inline bool serialSeen(int highest, uint64_t window, int serial)
+{
+    if (serial > highest)
+        return false;
+    if (highest - serial >= SERIAL_WINDOW)
+        return true;
+    return (window >> (highest - serial)) & 1;
+}
+
+inline void markSerialSeen(int &highest, uint64_t &window, int serial)
+{
+    if (serial > highest)
+    {
+        int shift = serial - highest;
+        window = shift >= SERIAL_WINDOW ? 0 : window << shift;
+        highest = serial;
+        window |= 1;
+    }
+    else if (highest - serial < SERIAL_WINDOW)
+    {
+        window |= (uint64_t)1 << (highest - serial);
+    }
+}
+
+// the request was not accepted after all: it can be received again
+inline void forgetSerial(int highest, uint64_t &window, int serial)
+{
+    if (serial <= highest && highest - serial < SERIAL_WINDOW)
+        window &= ~((uint64_t)1 << (highest - serial));
+}
+
+class SessionTable
+{
+public:
+    SessionTable();
+
+    last_req* find(int clientAddress);      // nullptr if the client has no session
+    last_req* insert(int clientAddress);    // new session of a client without one
+    bool remove(int clientAddress);
+    void clear();
+
+    int size() const;
+    size_t memoryUsage() const;             // bytes used by slots and records
+
+    // visits every session (snapshot serialization)
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i] >= 0)
+                visit(records[slots[i]]);
+    }
+
+private:
+    static constexpr int EMPTY = -1;
+    static constexpr int DELETED = -2;
+    static constexpr int INITIAL_CAPACITY = 16;
+    static constexpr double MAX_LOAD = 0.7;
+
+    std::vector<int> slots;             // position of the record in records, EMPTY or DELETED
+    std::deque<last_req> records;
+    std::vector<int> freeRecords;       // records of removed sessions, reused by insert
+    int count;
+    int tombstones;
+
+    static unsigned int hashAddress(int clientAddress);
+    int findSlot(int clientAddress) const;  // -1 if absent
+    void rehash(int newCapacity);
+};
+
+#endif /* SESSIONTABLE_H_ */
@@ -0,0 +1,198 @@
+/*
+ * StateMachine.cc
+ *
+ *  Replicated state machines applied by the Server.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "StateMachine.h"
+
+using namespace omnetpp;
+
+StateMachine *createStateMachine(const std::string &name)
+{
+    if (name == "registers")
+        return new RegisterStateMachine();
+    if (name == "kv")
+        return new KeyValueStateMachine();
+    throw cRuntimeError("Unknown state machine '%s'", name.c_str());
+}
+
+static void appendInt(std::string &data, int value)
+{
+    data.append((const char *) &value, sizeof(int));
+}
+
+static int readInt(const std::string &data, size_t &position)
+{
+    int value = 0;
+    if (position + sizeof(int) <= data.size())
+        memcpy(&value, data.data() + position, sizeof(int));
+    position = position + sizeof(int);
+    return value;
+}
+
+////
+// REGISTERS: the variables X and Y
+RegisterStateMachine::RegisterStateMachine()
+{
+    reset();
+}
+
+void RegisterStateMachine::apply(const log_entry &entry, state_machine_result &result)
+{
+    int *variable;
+    // FSM variable choice
+    if (entry.operandName == 'X')
+    {
+        variable = &var_X;
+    }
+    else
+    {
+        variable = &var_Y;
+    }
+
+    // FSM variable update
+    if (entry.operation == 'S')
+    {
+        (*variable) = entry.operandValue;
+    }
+    else if (entry.operation == 'A')
+    {
+        (*variable) = (*variable) + entry.operandValue;
+    }
+    else if (entry.operation == 'M')
+    {
+        (*variable) = (*variable) * entry.operandValue;
+    }
+    else
+    {
+        // not a register command (e.g. a kv client talking to a registers server): nothing is applied
+        EV << "RegisterStateMachine: unknown operation '" << entry.operation << "' rejected\n";
+        result.found = false;
+        result.value.clear();
+        return;
+    }
+    result.found = true;
+    result.value = std::to_string(*variable);
+}
+
+bool RegisterStateMachine::isReadOnly(char operation) const
+{
+    return false;
+}
+
+void RegisterStateMachine::read(const log_entry &entry, state_machine_result &result) const
+{
+    result.found = true;
+    result.value = std::to_string(entry.operandName == 'X' ? var_X : var_Y);
+}
+
+void RegisterStateMachine::takeSnapshot(std::string &data) const
+{
+    data.clear();
+    appendInt(data, var_X);
+    appendInt(data, var_Y);
+}
+
+void RegisterStateMachine::restoreSnapshot(const std::string &data)
+{
+    size_t position = 0;
+    var_X = readInt(data, position);
+    var_Y = readInt(data, position);
+}
+
+void RegisterStateMachine::reset()
+{
+    var_X = 1;
+    var_Y = 1;
+}
+
+std::string RegisterStateMachine::describe() const
+{
+    return "X==" + std::to_string(var_X) + "; Y==" + std::to_string(var_Y);
+}
+
+////
+// KEY-VALUE STORE: P == put, G == get, D == delete, I == increment by operandValue
+void KeyValueStateMachine::apply(const log_entry &entry, state_machine_result &result)
+{
+    std::string key(entry.key);
+    if (entry.operation == 'P')
+    {
+        store.put(key, std::string(entry.value, entry.valueLength));
+        result.found = true;
+    }
+    else if (entry.operation == 'G')
+    {
+        read(entry, result);
+    }
+    else if (entry.operation == 'D')
+    {
+        result.found = store.remove(key);
+    }
+    else if (entry.operation == 'I')
+    {
+        // the value is read as a decimal integer, a missing key counts as 0
+        std::string current;
+        long long number = 0;
+        if (store.get(key, current))
+            number = strtoll(current.c_str(), nullptr, 10);
+        result.found = true;
+        result.value = std::to_string(number + entry.operandValue);
+        store.put(key, result.value);
+    }
+}
+
+bool KeyValueStateMachine::isReadOnly(char operation) const
+{
+    return operation == 'G';
+}
+
+void KeyValueStateMachine::read(const log_entry &entry, state_machine_result &result) const
+{
+    result.found = store.get(std::string(entry.key), result.value);
+}
+
+void KeyValueStateMachine::takeSnapshot(std::string &data) const
+{
+    data.clear();
+    appendInt(data, store.size());
+    store.forEach([&data](const std::string &key, const std::string &value) {
+        appendInt(data, key.size());
+        data.append(key);
+        appendInt(data, value.size());
+        data.append(value);
+    });
+}
+
+void KeyValueStateMachine::restoreSnapshot(const std::string &data)
+{
+    store.clear();
+    size_t position = 0;
+    int numKeys = readInt(data, position);
+    for (int i = 0; i < numKeys && position < data.size(); i++)
+    {
+        int keyLength = readInt(data, position);
+        if (position + keyLength > data.size())
+            break;
+        std::string key = data.substr(position, keyLength);
+        position = position + keyLength;
+        int valueLength = readInt(data, position);
+        if (position + valueLength > data.size())
+            break;
+        std::string value = data.substr(position, valueLength);
+        position = position + valueLength;
+        store.put(key, value);
+    }
+}
+
+void KeyValueStateMachine::reset()
+{
+    store.clear();
+}
+
+std::string KeyValueStateMachine::describe() const
+{
+    return "keys==" + std::to_string(store.size());
+}
@@ -0,0 +1,77 @@
+/*
+ * StateMachine.h
+ *
+ *  Replicated state machine driven by the Server: committed entries are applied in log order,
+ *  and the whole state can be serialized into a snapshot and restored from it.
+ *  Two implementations are available, selected by the stateMachine parameter of the Server:
+ *   - "registers": the two integer variables X and Y (operations S, A, M)
+ *   - "kv": a key-value store on an open-addressing hash table (operations P, G, D, I)
+ */
+#ifndef STATEMACHINE_H_
+#define STATEMACHINE_H_
+
+#include <omnetpp.h>
+#include <string>
+#include "structs.h"
+#include "HashedKeyValueStore.h"
+
+// outcome of a command, sent back to the client for reads
+struct state_machine_result {
+    bool found = false;
+    std::string value;
+};
+
+class StateMachine
+{
+public:
+    virtual ~StateMachine() {}
+
+    virtual void apply(const log_entry &entry, state_machine_result &result) = 0;
+    virtual bool isReadOnly(char operation) const = 0;
+    // executes a read-only command against the current state, without going through apply
+    virtual void read(const log_entry &entry, state_machine_result &result) const = 0;
+
+    virtual void takeSnapshot(std::string &data) const = 0;
+    virtual void restoreSnapshot(const std::string &data) = 0;
+    virtual void reset() = 0;           // initial state
+
+    virtual std::string describe() const = 0;   // short summary for the display string
+};
+
+// throws cRuntimeError for an unknown name
+StateMachine *createStateMachine(const std::string &name);
+
+class RegisterStateMachine : public StateMachine
+{
+public:
+    RegisterStateMachine();
+
+    virtual void apply(const log_entry &entry, state_machine_result &result) override;
+    virtual bool isReadOnly(char operation) const override;
+    virtual void read(const log_entry &entry, state_machine_result &result) const override;
+    virtual void takeSnapshot(std::string &data) const override;
+    virtual void restoreSnapshot(const std::string &data) override;
+    virtual void reset() override;
+    virtual std::string describe() const override;
+
+private:
+    int var_X;
+    int var_Y;
+};
+
+class KeyValueStateMachine : public StateMachine
+{
+public:
+    virtual void apply(const log_entry &entry, state_machine_result &result) override;
+    virtual bool isReadOnly(char operation) const override;
+    virtual void read(const log_entry &entry, state_machine_result &result) const override;
+    virtual void takeSnapshot(std::string &data) const override;
+    virtual void restoreSnapshot(const std::string &data) override;
+    virtual void reset() override;
+    virtual std::string describe() const override;
+
+private:
+    HashedKeyValueStore store;
+};
+
+#endif /* STATEMACHINE_H_ */
@@ -4,40 +4,7 @@
  *  Created on: 13 mar 2022
  *      Author: ste_dochio
  */
-#include <stdio.h>
-#include <string.h>
-#include <omnetpp.h>
-#include <random>
-#include "VoteReply_m.h"
-#include "VoteRequest_m.h"
-#include "LogMessage_m.h"
-#include "LogMessageResponse_m.h"
-#include "HeartBeat_m.h"
-#include "HeartBeatResponse_m.h"
-#include "TimeOutNow_m.h"
-
-using namespace omnetpp;
-
-class Switch : public cSimpleModule
-{
-private:
-    int numberOfServers;
-    int numberOfClients;
-    double reliability;
-    VoteReply *voteReply;
-    VoteRequest *voteRequest;
-    HeartBeats *heartBeat;
-    HeartBeatResponse *heartBeatResponse;
-    LogMessage *logMessage;
-    LogMessageResponse *logMessageResponse;
-    TimeOutNow *timeout;
-protected:
-    virtual void initialize() override;
-    virtual void finish() override;
-    virtual void handleMessage(cMessage *msg) override;
-public:
-    virtual ~Switch();
-};
+#include "Switch.h"
 
 Define_Module(Switch);
 
@@ -46,19 +13,44 @@ void Switch::initialize()
     numberOfServers = getParentModule()->par("numServer");
     numberOfClients = getParentModule()->par("numClient");
     reliability = getParentModule()->par("channelsReliability");
+    updateRoutingTable();
+}
+
+// Rebuilds the table of the output gates and the server group. The ports are classified by the module
+// at the other end of either direction of the link; a port whose link is completely down keeps its class
+void Switch::updateRoutingTable()
+{
+    int numberOfPorts = gateSize("gateSwitch$o");
+    string serverString = "server";
+    routingTable.assign(numberOfPorts, nullptr);
+    isServerPort.resize(numberOfPorts, false);
+    serverGroup.clear();
+    for (int i = 0; i < numberOfPorts; i++)
+    {
+        cGate *out = gate("gateSwitch$o", i);
+        cGate *in = gate("gateSwitch$i", i);
+        routingTable[i] = out;
+        if (out->getNextGate() != nullptr)
+            isServerPort[i] = out->getPathEndGate()->getOwnerModule()->getName() == serverString;
+        else if (in->getPreviousGate() != nullptr)
+            isServerPort[i] = in->getPathStartGate()->getOwnerModule()->getName() == serverString;
+        if (isServerPort[i])
+            serverGroup.push_back(i);
+    }
 }
+
+// the server has been removed from the cluster: it is not a destination of the broadcasts anymore
+void Switch::removeFromServerGroup(int serverAddress)
+{
+    if (serverAddress >= 0 && serverAddress < isServerPort.size())
+        isServerPort[serverAddress] = false;
+    serverGroup.erase(std::remove(serverGroup.begin(), serverGroup.end(), serverAddress), serverGroup.end());
+}
+
 // here i redefine handleMessage method
 // invoked every time a message enters in the node
 void Switch::handleMessage(cMessage *msg)
 {
-    voteReply = dynamic_cast<VoteReply *>(msg);
-    voteRequest = dynamic_cast<VoteRequest *>(msg);
-    heartBeat = dynamic_cast<HeartBeats *>(msg);
-    heartBeatResponse = dynamic_cast<HeartBeatResponse *>(msg);
-    logMessage = dynamic_cast<LogMessage *>(msg);
-    logMessageResponse = dynamic_cast<LogMessageResponse *>(msg);
-    timeout = dynamic_cast<TimeOutNow *>(msg);
-
     bool switchIsFaulty = false;
     if (uniform(0,1) > reliability)
         switchIsFaulty = true;
@@ -68,94 +60,107 @@ void Switch::handleMessage(cMessage *msg)
     {
         bubble("A packet is lost!");
         EV << "Lost message " + std::to_string(msg->getId());
+        lostMessages++;
+        delete msg;
+        return;
     }
 
-    // PACKET IS CORRECTLY FORWARDED
-    else if ((voteRequest != nullptr) && (gate("gateSwitch$o",  voteRequest->getCandidateAddress())->isConnected()))
+    // PACKET IS CORRECTLY FORWARDED: the kind tells which field holds the destination
+    switch (msg->getKind())
     {
-        int srcAddress = voteRequest->getCandidateAddress();
+    case VOTE_REQUEST_KIND:
         // now i send in broadcast to all other server the vote request
-        for (cModule::GateIterator i(this); !i.end(); i++)
-        {
-            cGate *gate = *i;
-            // FROM omnet++ DOCUMENTATION: you cannot use the same message pointer in all send() calls,
-            // what you have to do instead is create copies (duplicates)
-            VoteRequest *voteRequestForward = voteRequest->dup();
-            // dst server index
-            int h = (gate)->getIndex();
-            const char *name = (gate)->getPathEndGate()->getOwnerModule()->getName();
-            std::string ex = "server";
-            // to avoid message to client and self message
-            if (h != srcAddress && name == ex)
-            {
-                send(voteRequestForward, gate->getName(), gate->getIndex());
-            }
-        }
-    }
-
-    else if ((voteReply != nullptr) && (gate("gateSwitch$o", voteReply->getLeaderAddress())->isConnected()))
-    {
-        int dest = voteReply->getLeaderAddress();
-        VoteReply *voteReplyForward = voteReply->dup();
-        send(voteReplyForward, "gateSwitch$o", dest);
-    }
-
-    else if ((heartBeat != nullptr) && (gate("gateSwitch$o",  heartBeat->getDestAddress())->isConnected()))
-    {
-        int dest = heartBeat->getDestAddress();
-        HeartBeats *heartBeatForward = heartBeat->dup();
-        send(heartBeatForward, "gateSwitch$o", dest);
+        multicastToServers(msg, static_cast<VoteRequest *>(msg)->getCandidateAddress());
+        break;
+    case PRE_VOTE_REQUEST_KIND:
+        multicastToServers(msg, static_cast<PreVoteRequest *>(msg)->getCandidateAddress());
+        break;
+    case PRE_VOTE_REPLY_KIND:
+        forward(msg, static_cast<PreVoteReply *>(msg)->getCandidateAddress());
+        break;
+    case VOTE_REPLY_KIND:
+        forward(msg, static_cast<VoteReply *>(msg)->getLeaderAddress());
+        break;
+    case HEARTBEAT_KIND:
+        forward(msg, static_cast<HeartBeats *>(msg)->getDestAddress());
+        break;
+    case HEARTBEAT_RESPONSE_KIND:
+        forward(msg, static_cast<HeartBeatResponse *>(msg)->getLeaderAddress());
+        break;
+    case TIMEOUT_NOW_KIND:
+        forward(msg, static_cast<TimeOutNow *>(msg)->getDestAddress());
+        break;
+    case INSTALL_SNAPSHOT_KIND:
+        forward(msg, static_cast<InstallSnapshot *>(msg)->getDestAddress());
+        break;
+    case READ_INDEX_REQUEST_KIND:
+        forward(msg, static_cast<ReadIndexRequest *>(msg)->getDestAddress());
+        break;
+    case READ_INDEX_RESPONSE_KIND:
+        forward(msg, static_cast<ReadIndexResponse *>(msg)->getDestAddress());
+        break;
+    case LOG_MESSAGE_KIND:
+        forward(msg, static_cast<LogMessage *>(msg)->getLeaderAddress());
+        break;
+    case LOG_MESSAGE_RESPONSE_KIND:
+        forward(msg, static_cast<LogMessageResponse *>(msg)->getClientAddress());
+        break;
+    default:
+        EV << "Switch: message of unknown kind " + std::to_string(msg->getKind()) + " dropped\n";
+        unroutableMessages++;
+        delete msg;
     }
+}
 
-    else if ((heartBeatResponse != nullptr) && (gate("gateSwitch$o",  heartBeatResponse->getLeaderAddress())->isConnected()))
+// The message itself is forwarded: it is dropped if the address is unknown or the link is down
+void Switch::forward(cMessage *msg, int destAddress)
+{
+    if (destAddress < 0 || destAddress >= routingTable.size() || !routingTable[destAddress]->isConnected())
     {
-        int dest = heartBeatResponse->getLeaderAddress();
-        HeartBeatResponse *responseForward = heartBeatResponse->dup();
-        send(responseForward, "gateSwitch$o", dest);
+        unroutableMessages++;
+        delete msg;
+        return;
     }
+    forwardedMessages++;
+    send(msg, routingTable[destAddress]);
+}
 
-    else if ((timeout != nullptr) && (gate("gateSwitch$o",  timeout->getDestAddress())->isConnected()))
+// FROM omnet++ DOCUMENTATION: you cannot use the same message pointer in all send() calls,
+// what you have to do instead is create copies (duplicates). The original goes to the last server
+void Switch::multicastToServers(cMessage *msg, int srcAddress)
+{
+    int last = -1;
+    for (int i = 0; i < serverGroup.size(); i++)
     {
-        int dest = timeout->getDestAddress();
-        TimeOutNow *responseForward = timeout->dup();
-        send(responseForward, "gateSwitch$o", dest);
+        int h = serverGroup[i];
+        // to avoid self message and servers whose link is down
+        if (h == srcAddress || !routingTable[h]->isConnected())
+            continue;
+        if (last >= 0)
+        {
+            forwardedMessages++;
+            send(msg->dup(), routingTable[last]);
+        }
+        last = h;
     }
-
-    else if ((logMessage != nullptr) && (gate("gateSwitch$o", logMessage->getLeaderAddress())->isConnected()))
+    if (last >= 0)
     {
-        int dest = logMessage->getLeaderAddress();
-        LogMessage *logMessageForward = logMessage->dup();
-        send(logMessageForward, "gateSwitch$o", dest);
+        forwardedMessages++;
+        send(msg, routingTable[last]);
     }
-
-    else if ((logMessageResponse != nullptr) && (gate("gateSwitch$o",  logMessageResponse->getClientAddress())->isConnected()))
+    else
     {
-        int dest = logMessageResponse->getClientAddress();
-        LogMessageResponse *responseForward = logMessageResponse->dup();
-        send(responseForward, "gateSwitch$o", dest);
+        delete msg;
     }
-
 }
 
 Switch::~Switch()
 {
-    cancelAndDelete(voteReply);
-    cancelAndDelete(voteRequest);
-    cancelAndDelete(heartBeat);
-    cancelAndDelete(heartBeatResponse);
-    cancelAndDelete(logMessage);
-    cancelAndDelete(logMessageResponse);
-    cancelAndDelete(timeout);
 }
 
 void Switch::finish()
 {
-    cancelAndDelete(voteReply);
-    cancelAndDelete(voteRequest);
-    cancelAndDelete(heartBeat);
-    cancelAndDelete(heartBeatResponse);
-    cancelAndDelete(logMessage);
-    cancelAndDelete(logMessageResponse);
-    cancelAndDelete(timeout);
+    recordScalar("forwardedMessages", forwardedMessages);
+    recordScalar("lostMessages", lostMessages);
+    recordScalar("unroutableMessages", unroutableMessages);
 }
-
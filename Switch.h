@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <string.h>
+#include <omnetpp.h>
+#include <random>
+#include <algorithm>
+#include "VoteReply_m.h"
+#include "VoteRequest_m.h"
+#include "LogMessage_m.h"
+#include "LogMessageResponse_m.h"
+#include "HeartBeat_m.h"
+#include "HeartBeatResponse_m.h"
+#include "TimeOutNow_m.h"
+#include "InstallSnapshot_m.h"
+#include "ReadIndexRequest_m.h"
+#include "ReadIndexResponse_m.h"
+#include "PreVoteRequest_m.h"
+#include "PreVoteReply_m.h"
+
+using namespace omnetpp;
+using std::vector;
+using std::string;
+
+#ifndef SWITCH_H_
+#define SWITCH_H_
+
+class Switch : public cSimpleModule
+{
+private:
+    int numberOfServers;
+    int numberOfClients;
+    double reliability;
+
+    // ROUTING: the address of a module is the index of its port on the switch
+    vector<cGate *> routingTable;   // output gate of each address
+    vector<bool> isServerPort;      // the port leads to a server (it stays one while its link is down)
+    vector<int> serverGroup;        // addresses of the servers, destinations of the broadcasts
+    long forwardedMessages = 0;
+    long lostMessages = 0;
+    long unroutableMessages = 0;
+protected:
+    virtual void initialize() override;
+    virtual void finish() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void forward(cMessage *msg, int destAddress);
+    virtual void multicastToServers(cMessage *msg, int srcAddress);
+public:
+    virtual ~Switch();
+    virtual void updateRoutingTable();          // to be called when the ports of the switch change
+    virtual void removeFromServerGroup(int serverAddress);
+};
+
+#endif /* SWITCH_H_ */
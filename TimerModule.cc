@@ -0,0 +1,62 @@
+/*
+ * TimerModule.cc
+ *
+ *  Reusable autoMessages with reschedule semantics.
+ */
+#include "TimerModule.h"
+
+TimerModule::~TimerModule()
+{
+    for (int i = 0; i < timers.size(); i++)
+        cancelAndDelete(timers[i].timer);
+}
+
+cMessage *TimerModule::createTimer(const char *name)
+{
+    timer_stats stats;
+    stats.timer = new cMessage(name);
+    timers.push_back(stats);
+    stats.timer->setContextPointer(&timers.back());
+    return stats.timer;
+}
+
+void TimerModule::startTimer(cMessage *timer, simtime_t delay)
+{
+    timer_stats *stats = (timer_stats *) timer->getContextPointer();
+    stats->starts++;
+    if (timer->isScheduled())
+    {
+        stats->restarts++;
+        cancelEvent(timer);
+    }
+    scheduleAt(simTime() + delay, timer);
+}
+
+void TimerModule::stopTimer(cMessage *timer)
+{
+    if (timer->isScheduled())
+    {
+        timer_stats *stats = (timer_stats *) timer->getContextPointer();
+        stats->cancellations++;
+        cancelEvent(timer);
+    }
+}
+
+// every start ends with exactly one of: fire, restart, cancellation, still running at the end
+void TimerModule::recordTimerStatistics()
+{
+    long totalFires = 0;
+    long totalCancellations = 0;
+    for (int i = 0; i < timers.size(); i++)
+    {
+        timer_stats &stats = timers[i];
+        long fires = stats.starts - stats.restarts - stats.cancellations - (stats.timer->isScheduled() ? 1 : 0);
+        std::string name = stats.timer->getName();
+        recordScalar((name + ":fires").c_str(), fires);
+        recordScalar((name + ":cancellations").c_str(), stats.cancellations + stats.restarts);
+        totalFires += fires;
+        totalCancellations += stats.cancellations + stats.restarts;
+    }
+    recordScalar("timerFires", totalFires);
+    recordScalar("timerCancellations", totalCancellations);
+}
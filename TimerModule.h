@@ -0,0 +1,37 @@
+/*
+ * TimerModule.h
+ *
+ *  Base class of the modules that use autoMessages as timers. Each logical timer is a single
+ *  cMessage created once and owned by the module: starting a timer that is already running
+ *  moves it instead of scheduling a second message, so nothing is allocated per tick.
+ */
+#ifndef TIMERMODULE_H_
+#define TIMERMODULE_H_
+
+#include <omnetpp.h>
+#include <deque>
+
+using namespace omnetpp;
+
+class TimerModule : public cSimpleModule
+{
+public:
+    virtual ~TimerModule();
+
+protected:
+    cMessage *createTimer(const char *name);
+    void startTimer(cMessage *timer, simtime_t delay);  // (re)arms the timer to fire after delay
+    void stopTimer(cMessage *timer);                    // no effect if the timer is not running
+    void recordTimerStatistics();                       // fires and cancellations of each timer (call from finish)
+
+private:
+    struct timer_stats {
+        cMessage *timer;
+        long starts = 0;
+        long restarts = 0;      // started while still running: the previous expiration is dropped
+        long cancellations = 0;
+    };
+    std::deque<timer_stats> timers;  // a deque does not move its elements: the timers point to their stats
+};
+
+#endif /* TIMERMODULE_H_ */
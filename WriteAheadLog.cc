@@ -0,0 +1,243 @@
+/*
+ * WriteAheadLog.cc
+ *
+ *  Durable storage of the persistent Raft state (currentTerm, lastVotedTerm, log entries and
+ *  snapshot) in one local file per server, with group commit.
+ */
+#include <unistd.h>
+#include "WriteAheadLog.h"
+
+// record types
+static const char TERM_RECORD = 'M';        // currentTerm, lastVotedTerm
+static const char ENTRY_RECORD = 'E';       // log_entry
+static const char TRUNCATE_RECORD = 'T';    // index of the first removed entry
+static const char SNAPSHOT_RECORD = 'S';    // state_snapshot
+
+WriteAheadLog::WriteAheadLog()
+{
+    file = nullptr;
+    persistedTerm = -1;
+    persistedVotedTerm = -1;
+    fsyncCount = 0;
+    bytesWritten = 0;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    if (file != nullptr)
+        fclose(file);
+}
+
+void WriteAheadLog::open(const std::string &path)
+{
+    this->path = path;
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        throw cRuntimeError("Cannot open write-ahead log file %s", path.c_str());
+}
+
+bool WriteAheadLog::isOpen() const
+{
+    return file != nullptr;
+}
+
+void WriteAheadLog::persistTermAndVote(int currentTerm, int lastVotedTerm)
+{
+    if (currentTerm == persistedTerm && lastVotedTerm == persistedVotedTerm)
+        return;
+    pendingRecords.push_back(TERM_RECORD);
+    appendInt(currentTerm);
+    appendInt(lastVotedTerm);
+    persistedTerm = currentTerm;
+    persistedVotedTerm = lastVotedTerm;
+}
+
+void WriteAheadLog::appendEntry(const log_entry &entry)
+{
+    pendingRecords.push_back(ENTRY_RECORD);
+    appendRaw(&entry, sizeof(log_entry));
+}
+
+void WriteAheadLog::appendTruncate(int fromIndex)
+{
+    pendingRecords.push_back(TRUNCATE_RECORD);
+    appendInt(fromIndex);
+}
+
+void WriteAheadLog::appendSnapshot(const state_snapshot &snapshot)
+{
+    pendingRecords.push_back(SNAPSHOT_RECORD);
+    appendInt(snapshot.lastIncludedIndex);
+    appendInt(snapshot.lastIncludedTerm);
+    appendRaw(&snapshot.lastAppliedEntryTime, sizeof(double));
+    appendInt(snapshot.stateMachineData.size());
+    pendingRecords.append(snapshot.stateMachineData);
+    appendInt(snapshot.configuration.size());
+    for (int i = 0; i < snapshot.configuration.size(); i++)
+        appendInt(snapshot.configuration[i]);
+    appendInt(snapshot.requestTable.size());
+    snapshot.requestTable.forEach([this](const last_req &request) {
+        appendRaw(&request, sizeof(last_req));
+    });
+}
+
+void WriteAheadLog::rewrite(const state_snapshot &snapshot, const RaftLog &logEntries, int currentTerm, int lastVotedTerm)
+{
+    // the records still pending belong to the old file: they are superseded by the new one
+    pendingRecords.clear();
+    appendSnapshot(snapshot);
+    pendingRecords.push_back(TERM_RECORD);
+    appendInt(currentTerm);
+    appendInt(lastVotedTerm);
+    persistedTerm = currentTerm;
+    persistedVotedTerm = lastVotedTerm;
+    for (int index = logEntries.getStartIndex(); index <= logEntries.getLastIndex(); index++)
+        appendEntry(logEntries.getEntry(index));
+
+    std::string tmpPath = path + ".tmp";
+    FILE *tmpFile = fopen(tmpPath.c_str(), "wb");
+    if (tmpFile == nullptr)
+        throw cRuntimeError("Cannot open write-ahead log file %s", tmpPath.c_str());
+    fwrite(pendingRecords.data(), 1, pendingRecords.size(), tmpFile);
+    syncFile(tmpFile);
+    bytesWritten = bytesWritten + pendingRecords.size();
+    pendingRecords.clear();
+    fclose(tmpFile);
+    fclose(file);
+    rename(tmpPath.c_str(), path.c_str());
+    file = fopen(path.c_str(), "ab");
+}
+
+bool WriteAheadLog::hasPendingWrites() const
+{
+    return !pendingRecords.empty();
+}
+
+void WriteAheadLog::flush()
+{
+    if (pendingRecords.empty())
+        return;
+    fwrite(pendingRecords.data(), 1, pendingRecords.size(), file);
+    syncFile(file);
+    bytesWritten = bytesWritten + pendingRecords.size();
+    pendingRecords.clear();
+}
+
+void WriteAheadLog::discardPendingWrites()
+{
+    pendingRecords.clear();
+    // the term and vote in memory are lost too: the next change must be written again
+    persistedTerm = -1;
+    persistedVotedTerm = -1;
+}
+
+bool WriteAheadLog::recover(wal_recovered_state &state)
+{
+    FILE *input = fopen(path.c_str(), "rb");
+    if (input == nullptr)
+        return false;
+    int type;
+    while ((type = fgetc(input)) != EOF)
+    {
+        if (type == TERM_RECORD)
+        {
+            if (fread(&state.currentTerm, sizeof(int), 1, input) != 1 || fread(&state.lastVotedTerm, sizeof(int), 1, input) != 1)
+                break;
+        }
+        else if (type == ENTRY_RECORD)
+        {
+            log_entry entry;
+            if (fread(&entry, sizeof(log_entry), 1, input) != 1)
+                break;
+            // an entry overwrites the conflicting entries that follow it
+            while (!state.entries.empty() && state.entries.back().entryLogIndex >= entry.entryLogIndex)
+                state.entries.pop_back();
+            state.entries.push_back(entry);
+        }
+        else if (type == TRUNCATE_RECORD)
+        {
+            int fromIndex;
+            if (fread(&fromIndex, sizeof(int), 1, input) != 1)
+                break;
+            while (!state.entries.empty() && state.entries.back().entryLogIndex >= fromIndex)
+                state.entries.pop_back();
+        }
+        else if (type == SNAPSHOT_RECORD)
+        {
+            state_snapshot snapshot;
+            int stateMachineDataSize, configurationSize, numRequests;
+            if (fread(&snapshot.lastIncludedIndex, sizeof(int), 1, input) != 1
+                    || fread(&snapshot.lastIncludedTerm, sizeof(int), 1, input) != 1
+                    || fread(&snapshot.lastAppliedEntryTime, sizeof(double), 1, input) != 1
+                    || fread(&stateMachineDataSize, sizeof(int), 1, input) != 1)
+                break;
+            snapshot.stateMachineData.resize(stateMachineDataSize);
+            if (stateMachineDataSize > 0 && fread(&snapshot.stateMachineData[0], 1, stateMachineDataSize, input) != stateMachineDataSize)
+                break;
+            if (fread(&configurationSize, sizeof(int), 1, input) != 1)
+                break;
+            snapshot.configuration.resize(configurationSize);
+            if (configurationSize > 0 && fread(snapshot.configuration.data(), sizeof(int), configurationSize, input) != configurationSize)
+                break;
+            if (fread(&numRequests, sizeof(int), 1, input) != 1)
+                break;
+            bool complete = true;
+            for (int i = 0; i < numRequests; i++)
+            {
+                last_req request;
+                if (fread(&request, sizeof(last_req), 1, input) != 1)
+                {
+                    complete = false;
+                    break;
+                }
+                *snapshot.requestTable.insert(request.clientAddress) = request;
+            }
+            if (!complete)
+                break;
+            state.snapshot = snapshot;
+            state.hasSnapshot = true;
+            // the entries compacted into the snapshot are not needed anymore
+            vector<log_entry> following;
+            for (int i = 0; i < state.entries.size(); i++)
+                if (state.entries[i].entryLogIndex > snapshot.lastIncludedIndex)
+                    following.push_back(state.entries[i]);
+            state.entries = following;
+        }
+        else
+        {
+            // torn write at the end of the file
+            break;
+        }
+    }
+    fclose(input);
+    persistedTerm = state.currentTerm;
+    persistedVotedTerm = state.lastVotedTerm;
+    return true;
+}
+
+long WriteAheadLog::getFsyncCount() const
+{
+    return fsyncCount;
+}
+
+long WriteAheadLog::getBytesWritten() const
+{
+    return bytesWritten;
+}
+
+void WriteAheadLog::appendRaw(const void *data, size_t length)
+{
+    pendingRecords.append((const char *) data, length);
+}
+
+void WriteAheadLog::appendInt(int value)
+{
+    appendRaw(&value, sizeof(int));
+}
+
+void WriteAheadLog::syncFile(FILE *target)
+{
+    fflush(target);
+    fsync(fileno(target));
+    fsyncCount++;
+}
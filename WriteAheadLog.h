@@ -0,0 +1,64 @@
+/*
+ * WriteAheadLog.h
+ *
+ *  Durable storage of the persistent Raft state (currentTerm, lastVotedTerm, log entries and
+ *  snapshot) in one local file per server. Records are buffered in memory and made durable
+ *  together by flush() (group commit): whatever is still buffered when the server crashes is lost.
+ */
+#ifndef WRITEAHEADLOG_H_
+#define WRITEAHEADLOG_H_
+
+#include <omnetpp.h>
+#include <stdio.h>
+#include <string>
+#include "structs.h"
+#include "RaftLog.h"
+
+// persistent state rebuilt from the file after a crash
+struct wal_recovered_state {
+    int currentTerm = 1;
+    int lastVotedTerm = 0;
+    bool hasSnapshot = false;
+    state_snapshot snapshot;
+    vector<log_entry> entries;      // entries following the snapshot, in index order
+};
+
+class WriteAheadLog
+{
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    void open(const std::string &path);         // creates (or empties) the file
+    bool isOpen() const;
+
+    void persistTermAndVote(int currentTerm, int lastVotedTerm); // no record if nothing changed
+    void appendEntry(const log_entry &entry);
+    void appendTruncate(int fromIndex);
+    // rewrites the file with the snapshot, term, vote and the entries still in the log (synchronous)
+    void rewrite(const state_snapshot &snapshot, const RaftLog &logEntries, int currentTerm, int lastVotedTerm);
+
+    bool hasPendingWrites() const;
+    void flush();                               // group commit: one write and one fsync for all the pending records
+    void discardPendingWrites();                // crash: the records not flushed yet are lost
+    bool recover(wal_recovered_state &state);   // replays the file
+
+    long getFsyncCount() const;
+    long getBytesWritten() const;
+
+private:
+    std::string path;
+    FILE *file;
+    std::string pendingRecords;     // records appended since the last flush
+    int persistedTerm;
+    int persistedVotedTerm;
+    long fsyncCount;
+    long bytesWritten;
+
+    void appendSnapshot(const state_snapshot &snapshot);
+    void appendRaw(const void *data, size_t length);
+    void appendInt(int value);
+    void syncFile(FILE *target);
+};
+
+#endif /* WRITEAHEADLOG_H_ */
@@ -4,9 +4,17 @@
  *  Created on: Aug 16, 2022
  *      Author: manfredi
  */
+#ifndef STRUCTS_H_
+#define STRUCTS_H_
+
+#include "SessionTable.h"
+
 using namespace omnetpp;
 using std::vector;
 
+#define KV_KEY_SIZE 16      // key-value commands: max key length, terminating NUL included
+#define KV_VALUE_SIZE 32    // key-value commands: max value length
+
 struct log_entry {
     int clientAddress;
     int entryLogIndex;
@@ -17,17 +25,37 @@ struct log_entry {
     char operation;
     int addressServerToRemove = -1;    // n == remove server n
     int addressServerToAdd = -1;       // n == add server n
+    char key[KV_KEY_SIZE] = {0};       // key-value commands only
+    char value[KV_VALUE_SIZE] = {0};   // not NUL-terminated, valueLength bytes are used
+    int valueLength = 0;
+    double entryTime = 0;              // log time: simulation time at which the leader created the entry
 };
 
-struct last_req {
+// AppendEntries sent to a follower and not yet acknowledged (pipelined replication)
+struct inflight_append {
+    int firstIndex;     // index of the first entry carried by the append
+    int lastIndex;      // index of the last entry carried by the append
+    simtime_t sendTime;
+};
+
+// read-only request waiting on the leader for the confirmation of its leadership (ReadIndex)
+struct pending_read {
     int clientAddress;
-    int lastArrivedSerial = 0;     // serial number of the last arrived from this client. It may either be in the log or not (change membership messages are stored later on)
-    int lastLoggedIndex = -1;       // index of the last entry added to the log
-    int lastAppliedSerial = 0;
+    int serialNumber;
+    int readIndex;      // commitIndex when the request arrived
+    int readRound;      // heartbeat round that confirms the leadership for this read
+    log_entry command;  // the read, as passed to StateMachine::read
+    bool forFollower = false;   // leader only: ReadIndexRequest of a follower, clientAddress is the follower and serialNumber the request id
 };
 
-struct client_requests_table {
-    int size;
-    vector<vector<last_req>> entries;
+// Applied state of the server up to lastIncludedIndex, it replaces the compacted log prefix
+struct state_snapshot {
+    int lastIncludedIndex = -1;     // index of the last entry compacted into the snapshot
+    int lastIncludedTerm = 0;       // term of that entry
+    double lastAppliedEntryTime = 0; // log time of the entry at lastIncludedIndex
+    std::string stateMachineData;   // serialized by StateMachine::takeSnapshot
+    vector<int> configuration;
+    SessionTable requestTable;
 };
 
+#endif /* STRUCTS_H_ */